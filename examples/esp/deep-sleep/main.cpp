@@ -0,0 +1,19 @@
+#include <Arduino.h>
+#include <EspWifi.h>
+
+Property temperatureProperty("temperature");
+
+void setup() {
+  Serial.begin(115200);
+  temperatureProperty.setDataType(DataType::Integer).setAccessMode(AccessMode::Read);
+  // wake every 5 minutes, publish and go back to sleep
+  Sensora.setSleepCycle(300);
+  Sensora.setup();
+
+  // simulate a value between 0 and 15 degrees
+  temperatureProperty.setValue(static_cast<int>(random(0, 15)));
+}
+
+void loop() {
+  Sensora.loop();
+}
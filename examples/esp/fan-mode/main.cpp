@@ -0,0 +1,26 @@
+#include <Arduino.h>
+#include <EspWifi.h>
+
+#define FAN_PIN 5
+
+const char* const fanModes[] = {"off", "eco", "boost"};
+EnumProperty<3> fanMode("fan_mode", fanModes);
+
+void handleFanModeChange(uint8_t mode) {
+  SENSORA_LOGI("fan mode is now '%s'", fanModes[mode]);
+  // duty cycle per mode, indexed like fanModes
+  const uint8_t duty[] = {0, 96, 255};
+  analogWrite(FAN_PIN, duty[mode]);
+}
+
+void setup() {
+  Serial.begin(115200);
+  pinMode(FAN_PIN, OUTPUT);
+  fanMode.setAccessMode(AccessMode::ReadWrite).setPersistent();
+  fanMode.subscribe(handleFanModeChange);
+  Sensora.setup();
+}
+
+void loop() {
+  Sensora.loop();
+}
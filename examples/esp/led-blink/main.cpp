@@ -13,8 +13,8 @@ void handleLedChange(PropertyValue& val) {
 
 void setup() {
   Serial.begin(115200);
-  led.setDataType(DataType::Boolean).setAccessMode(AccessMode::Write).subscribe(handleLedChange);
   pinMode(LED_BUILTIN, OUTPUT);
+  led.setDataType(DataType::Boolean).setAccessMode(AccessMode::Write).setPersistent().subscribe(handleLedChange);
   Sensora.setup();
 }
 
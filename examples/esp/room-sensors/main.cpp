@@ -4,9 +4,14 @@
 Property temperatureProperty("temperature");
 Property humidityProperty("humidity");
 
+// 15 minutes of temperature readings, uploaded as one compressed batch
+uint8_t temperatureHistory[1024];
+
 void setup() {
   Serial.begin(115200);
-  temperatureProperty.setDataType(DataType::Integer).setAccessMode(AccessMode::Read);
+  temperatureProperty.setDataType(DataType::Integer)
+      .setAccessMode(AccessMode::Read)
+      .setHistory(temperatureHistory, sizeof(temperatureHistory), 5000, 15 * 60 * 1000UL);
   humidityProperty.setDataType(DataType::Integer).setAccessMode(AccessMode::Read);
   Sensora.setup();
 }
@@ -0,0 +1,24 @@
+#include <Arduino.h>
+#include <EspWifi.h>
+
+// call with cid=<id>;method=analog_read;pin=34, answered with cid=<id>;value=<raw>
+bool analogReadMethod(const uint8_t* request, int length, SensoraPayload& response) {
+  char pin[4];
+  if (!extractPayload(request, length, "pin", pin, sizeof(pin))) {
+    response.add("reason", "missing pin");
+    return false;
+  }
+  response.add("value", static_cast<uint32_t>(analogRead(parseInt(pin))));
+  return true;
+}
+
+Method analogReadCall("analog_read", analogReadMethod);
+
+void setup() {
+  Serial.begin(115200);
+  Sensora.setup();
+}
+
+void loop() {
+  Sensora.loop();
+}
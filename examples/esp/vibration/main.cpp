@@ -0,0 +1,36 @@
+#include <Arduino.h>
+#include <EspWifi.h>
+
+#define SENSOR_PIN 34
+#define SAMPLE_INTERVAL_US 1000
+
+Property vibrationProperty("vibration");
+Property peakProperty("vibration_peak");
+
+float vibrationSamples[256];
+float peakSamples[256];
+unsigned long sampledAt;
+
+void setup() {
+  Serial.begin(115200);
+  // publish the 95th percentile and the peak of each 10 second window
+  vibrationProperty.setDataType(DataType::Float)
+      .setSyncStrategy(SyncStrategy::Periodic, 10000)
+      .setSampleBuffer(vibrationSamples, 256)
+      .setAggregation(Aggregation::Percentile, 0.95);
+  peakProperty.setDataType(DataType::Float)
+      .setSyncStrategy(SyncStrategy::Periodic, 10000)
+      .setSampleBuffer(peakSamples, 256)
+      .setAggregation(Aggregation::Max);
+  Sensora.setup();
+}
+
+void loop() {
+  if (micros() - sampledAt >= SAMPLE_INTERVAL_US) {
+    sampledAt = micros();
+    float v = analogRead(SENSOR_PIN);
+    vibrationProperty.pushSample(v);
+    peakProperty.pushSample(v);
+  }
+  Sensora.loop();
+}
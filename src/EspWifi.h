@@ -18,13 +18,22 @@
 #define EspWifi_h
 
 #include <WiFi.h>
+#include <esp_sleep.h>
 #include <SensoraDevice.h>
+#include <Transport/MqttSnTransport.h>
+#ifdef SENSORA_MQTT_TLS
+#include <Transport/EspTlsClient.h>
+#endif
 #include <Storage/StoragePreferences.h>
+#ifdef SENSORA_OTA
+#include <Ota/EspOtaWriter.h>
+#endif
 #include <Provision/SensoraProvision.h>
 
+template <class Transport>
 class EspProvision : public SerialProvision {
  public:
-  EspProvision(Transp& transport) : SerialProvision(), transp(transport) {}
+  EspProvision(Transport& transport) : SerialProvision(), transp(transport) {}
 
   void setup() {
     SerialProvision::setup();
@@ -69,7 +78,7 @@ class EspProvision : public SerialProvision {
 
  private:
   WiFiConfig wifiConfig;
-  Transp& transp;
+  Transport& transp;
   CmdError cmdError;
   unsigned long firstNetworkCheck = 0;
   unsigned long firstMqttCheck = 0;
@@ -175,6 +184,7 @@ class EspProvision : public SerialProvision {
   void handleFinishProvision() {
     writeConfig("device", deviceConfig);
     writeConfig("netw", wifiConfig);
+    storageFlush();
     ESP.restart();
     while (true) {
     }
@@ -183,7 +193,7 @@ class EspProvision : public SerialProvision {
 
 class EspWiFi {
  public:
-  EspWiFi() : provision(nullptr) {
+  EspWiFi() : provision(nullptr), fastConnecting(false), syncStep(nullptr), syncArg(nullptr) {
   }
 
   void setup() {
@@ -191,6 +201,10 @@ class EspWiFi {
     loadConfig();
   }
 
+  void loop() {
+    storageLoop();
+  }
+
   bool isProvision() {
     if (validateDeviceCredentials(deviceConfig.deviceId, deviceConfig.deviceToken) &&
         validateWiFiCredentials(wifiConfig.ssid, wifiConfig.password)) {
@@ -199,9 +213,10 @@ class EspWiFi {
     return true;
   }
 
-  void setupProvision(Transp& transport) {
+  template <class Transport>
+  void setupProvision(Transport& transport) {
     SENSORA_LOGD("setting up ESP provision");
-    provision = new EspProvision(transport);
+    provision = new EspProvision<Transport>(transport);
     provision->setup();
   }
 
@@ -215,6 +230,23 @@ class EspWiFi {
     if (isNetworkConnected()) {
       return;
     }
+    if (fastConnecting) {
+      SENSORA_LOGW("fast connect to ssid '%s' failed, scanning", wifiConfig.ssid);
+      fastConnecting = false;
+      wifiCache.channel = 0;
+      WiFi.disconnect();
+#ifdef SENSORA_WIFI_STATIC_IP
+      WiFi.config(IPAddress(), IPAddress(), IPAddress());
+#endif
+    } else if (SENSORA_WIFI_FAST_CONNECT && wifiCache.channel > 0) {
+      SENSORA_LOGD("fast connect to ssid '%s' on channel %d", wifiConfig.ssid, wifiCache.channel);
+#ifdef SENSORA_WIFI_STATIC_IP
+      WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway), IPAddress(wifiCache.subnet), IPAddress(wifiCache.dns));
+#endif
+      fastConnecting = true;
+      WiFi.begin(wifiConfig.ssid, strlen(wifiConfig.password) ? wifiConfig.password : nullptr, wifiCache.channel, wifiCache.bssid);
+      return;
+    }
     if (strlen(wifiConfig.password)) {
       WiFi.begin(wifiConfig.ssid, wifiConfig.password);
     } else {
@@ -224,20 +256,92 @@ class EspWiFi {
 
   void readInfo(SensoraPayload& payload) {
     IPAddress ip = WiFi.localIP();
-    payload.add("ip", ip.toString());
-    payload.add("mac", WiFi.macAddress());
+    char buf[18];
+    size_t len = 0;
+    for (int i = 0; i < 4; i++) {
+      if (i > 0) {
+        buf[len++] = '.';
+      }
+      len += formatUInt(ip[i], buf + len);
+    }
+    payload.add("ip", buf);
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    formatHex(mac, sizeof(mac), buf, ':', true);
+    payload.add("mac", buf);
   }
 
   void readStats(SensoraPayload& payload) {
     payload.add("wifi_signal", WiFi.RSSI());
-    payload.add("free_heap", String(ESP.getFreeHeap()));
+    payload.add("free_heap", static_cast<uint32_t>(ESP.getFreeHeap()));
   }
 
   bool isNetworkConnected() {
     return WiFi.status() == WL_CONNECTED;
   }
 
+  template <typename T>
+  bool readConfig(const char* key, T& config) {
+    return ::readConfig(key, config);
+  }
+
+  template <typename T>
+  void writeConfig(const char* key, const T& config) {
+    ::writeConfig(key, config);
+  }
+
+  bool wokeFromSleep() {
+    return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+  }
+
+  void deepSleep(unsigned long seconds) {
+    storageFlush();
+    WiFi.disconnect(true);
+    esp_sleep_enable_timer_wakeup(seconds * 1000000ULL);
+    esp_deep_sleep_start();
+  }
+
+  // runs step(arg) forever on SENSORA_TASK_CORE, leaving the loop() core to
+  // the application
+  bool startSyncTask(void (*step)(void*), void* arg) {
+    syncStep = step;
+    syncArg = arg;
+    return xTaskCreatePinnedToCore(syncTask, "sensora", SENSORA_TASK_STACK_SIZE, this, 1, nullptr, SENSORA_TASK_CORE) == pdPASS;
+  }
+
+  unsigned long networkConnTimeout() {
+    return fastConnecting ? SENSORA_WIFI_FAST_CONNECT_TIMEOUT_MS : 10000LU;
+  }
+
+  void onNetworkConnected() {
+    fastConnecting = false;
+    WiFiCache cache;
+    memset(&cache, 0, sizeof(WiFiCache));
+    memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+    cache.channel = WiFi.channel();
+    cache.ip = WiFi.localIP();
+    cache.gateway = WiFi.gatewayIP();
+    cache.subnet = WiFi.subnetMask();
+    cache.dns = WiFi.dnsIP();
+    if (memcmp(&cache, &wifiCache, sizeof(WiFiCache)) != 0) {
+      SENSORA_LOGD("saving network cache, channel %d", cache.channel);
+      wifiCache = cache;
+      writeConfig("wcache", wifiCache);
+    }
+  }
+
  private:
+  void (*syncStep)(void*);
+  void* syncArg;
+
+  static void syncTask(void* arg) {
+    EspWiFi* board = static_cast<EspWiFi*>(arg);
+    for (;;) {
+      board->syncStep(board->syncArg);
+      vTaskDelay(1);
+    }
+  }
+
   void initStorage() {
     SENSORA_LOGD("EspWifi setup storage");
     storageBegin();
@@ -247,20 +351,54 @@ class EspWiFi {
     SENSORA_LOGD("init config");
     readConfig("device", deviceConfig);
     readConfig("netw", wifiConfig);
+    if (!readConfig("wcache", wifiCache)) {
+      wifiCache.channel = 0;
+    }
     deviceConfig.connectionType = ConnectionType::WiFi;
   }
 
   Preferences preferences;
   WiFiConfig wifiConfig;
-  EspProvision* provision;
+  WiFiCache wifiCache;
+  SerialProvision* provision;
+  bool fastConnecting;
 };
 
+#ifdef SENSORA_TRANSPORT_MQTTSN
+WiFiUDP wifiUdp;
+typedef MqttSnTransport<WiFiUDP> EspTransport;
+EspTransport transport(wifiUdp);
+#elif defined(SENSORA_MQTT_TLS)
+#ifndef SENSORA_MQTT_CA_CERT
+#error "SENSORA_MQTT_TLS requires SENSORA_MQTT_CA_CERT to be set to the broker CA certificate (PEM)"
+#endif
+#ifndef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+#warning "CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS is disabled in sdkconfig, every reconnect does a full TLS handshake"
+#endif
+EspTlsClient wifiClient(SENSORA_MQTT_CA_CERT);
+typedef Transp EspTransport;
+EspTransport transport(wifiClient);
+#else
 WiFiClient wifiClient;
-Transp transport(wifiClient);
-SensoraDevice<EspWiFi> Sensora(transport);
+typedef Transp EspTransport;
+EspTransport transport(wifiClient);
+#endif
+SensoraDevice<EspWiFi, EspTransport> Sensora(transport);
+
+#ifdef SENSORA_LAN
+WiFiUDP lanUdp;
+LanEndpoint<WiFiUDP, SensoraDevice<EspWiFi, EspTransport>> SensoraLan(lanUdp, Sensora);
+#endif
+
+#ifdef SENSORA_OTA
+// plain client, images are fetched from http:// URLs only
+WiFiClient otaClient;
+EspOtaWriter otaWriter;
+OtaUpdater<WiFiClient, SensoraDevice<EspWiFi, EspTransport>> SensoraOta(otaClient, otaWriter, Sensora);
+#endif
 
 template <>
-void SensoraDevice<EspWiFi>::onMessage(int len) {
+void SensoraDevice<EspWiFi, EspTransport>::onMessage(int len) {
   Sensora.handleMessage(len);
 }
 
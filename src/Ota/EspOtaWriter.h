@@ -0,0 +1,47 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EspOtaWriter_h
+#define EspOtaWriter_h
+
+#include <Update.h>
+
+// Writes the image to the next OTA app partition through the Update
+// library, which erases and programs flash as the bytes come in.
+class EspOtaWriter : public OtaWriter {
+ public:
+  bool begin(size_t size) {
+    return Update.begin(size);
+  }
+
+  bool write(const uint8_t* data, size_t len) {
+    return Update.write(const_cast<uint8_t*>(data), len) == len;
+  }
+
+  bool finish() {
+    return Update.end();
+  }
+
+  void abort() {
+    Update.abort();
+  }
+
+  void restart() {
+    ESP.restart();
+  }
+};
+
+#endif
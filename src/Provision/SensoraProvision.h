@@ -39,12 +39,12 @@ class SerialProvision {
  public:
   SerialProvision() : sensoraLink(), ps(ProvisionState::WaitNetworkConfig) {}
 
-  void setup() {
+  virtual void setup() {
     SENSORA_LOGD("setup serial at default baud rate 115200");
     // Serial.begin(115200);
   }
 
-  void loop() {
+  virtual void loop() {
     if (Serial.available() > 0) {
       uint8_t b = Serial.read();
       if (!sensoraLink.readByte(b)) {
@@ -19,9 +19,18 @@
 
 #define MQTT_HOST "mqtt.sensora.io"
 
+#ifndef MQTT_PORT
+#ifdef SENSORA_MQTT_TLS
+#define MQTT_PORT 8883
+#else
+#define MQTT_PORT 1883
+#endif
+#endif
+
 #define SENSORA_MAX_DEVICE_ID_LEN 32 + 1
 #define SENSORA_MAX_DEVICE_TOKEN_LEN 32 + 1
 #define SENSORA_MAX_PROPERTY_ID_LEN 32 + 1
+#define SENSORA_MAX_TOPIC_LEN 96
 
 #define MAX_WIFI_SSID_LENGTH 32 + 1
 #define MAX_WIFI_PASSWORD_LENGTH 64 + 1
@@ -29,10 +38,100 @@
 #define DEVICE_MAX_ATTRIBUTES 20
 #define DEVICE_MAX_PROPERTIES 10
 
+#ifndef DEVICE_MAX_METHODS
+#define DEVICE_MAX_METHODS 8
+#endif
+
+#define SENSORA_MAX_CALL_ID_LEN 16 + 1
+
+#ifndef SENSORA_MAX_ROUTE_NODES
+#define SENSORA_MAX_ROUTE_NODES (2 * DEVICE_MAX_PROPERTIES + 24)
+#endif
+
+#ifndef SENSORA_MAX_GROUPS
+#define SENSORA_MAX_GROUPS 4
+#endif
+
 #ifndef DEVICE_STATS_SYNC_INTERVAL_MS
 #define DEVICE_STATS_SYNC_INTERVAL_MS 15000
 #endif
 
+#ifndef SENSORA_MQTT_CLEAN_SESSION
+#define SENSORA_MQTT_CLEAN_SESSION true
+#endif
+
+#ifndef SENSORA_WIFI_FAST_CONNECT
+#define SENSORA_WIFI_FAST_CONNECT true
+#endif
+
+#ifndef SENSORA_WIFI_FAST_CONNECT_TIMEOUT_MS
+#define SENSORA_WIFI_FAST_CONNECT_TIMEOUT_MS 3000
+#endif
+
+#ifndef STORAGE_CACHE_ENTRIES
+#define STORAGE_CACHE_ENTRIES 6
+#endif
+
+#ifndef STORAGE_RECORD_SIZE
+#define STORAGE_RECORD_SIZE 128
+#endif
+
+#ifndef STORAGE_FLUSH_DELAY_MS
+#define STORAGE_FLUSH_DELAY_MS 5000
+#endif
+
+#ifndef DEVICE_INBOX_SIZE
+#define DEVICE_INBOX_SIZE 8
+#endif
+
+#ifndef DEVICE_INBOX_BUDGET_US
+#define DEVICE_INBOX_BUDGET_US 2000
+#endif
+
+// time one loop() may spend publishing property state or info, the walk
+// over the property list resumes where it stopped on the next loop()
+#ifndef DEVICE_SYNC_BUDGET_US
+#define DEVICE_SYNC_BUDGET_US 3000
+#endif
+
+// publishes per loop() during property sync, 0 for no limit
+#ifndef DEVICE_SYNC_MAX_PUBLISHES
+#define DEVICE_SYNC_MAX_PUBLISHES 4
+#endif
+
+// publishes of property state per second for the whole device and the
+// burst allowed on top, 0 disables the limit. Off by default, turn it on
+// here or with setRateLimit()
+#ifndef DEVICE_RATE_LIMIT
+#define DEVICE_RATE_LIMIT 0
+#endif
+
+#ifndef DEVICE_RATE_BURST
+#define DEVICE_RATE_BURST 0
+#endif
+
+#define SENSORA_MAX_BATCH_ID_LEN 16 + 1
+
+#ifndef SENSORA_MAX_PENDING_ACKS
+#define SENSORA_MAX_PENDING_ACKS 4
+#endif
+
+#ifndef SENSORA_MAX_SERVICES
+#define SENSORA_MAX_SERVICES 2
+#endif
+
+#ifndef SENSORA_TASK_STACK_SIZE
+#define SENSORA_TASK_STACK_SIZE 8192
+#endif
+
+#ifndef SENSORA_TASK_CORE
+#define SENSORA_TASK_CORE 0
+#endif
+
+#ifndef PROPERTY_PERSIST_DELAY_MS
+#define PROPERTY_PERSIST_DELAY_MS 2000
+#endif
+
 #ifndef PROPERTY_BUFFER_SIZE
 #define PROPERTY_BUFFER_SIZE 64
 #endif
@@ -53,6 +152,16 @@ struct WiFiConfig {
   char password[MAX_WIFI_PASSWORD_LENGTH];
 };
 
+// last successful connection, reused to skip the scan and DHCP
+struct WiFiCache {
+  uint8_t bssid[6];
+  int32_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
 struct DeviceConfig {
   char deviceId[SENSORA_MAX_DEVICE_ID_LEN];
   char deviceToken[SENSORA_MAX_DEVICE_TOKEN_LEN];
@@ -20,10 +20,21 @@
 #include <SensoraConfig.h>
 #include <SensoraLogger.h>
 #include <SensoraUtil.h>
+#include <SensoraHash.h>
 #include <SensoraPayload.h>
 #include <SensoraLink.h>
+#include <SensoraQueue.h>
+#include <SensoraWindow.h>
+#include <SensoraRate.h>
+#include <SensoraHistory.h>
+#include <SensoraTypes.h>
 #include <SensoraProperty.h>
+#include <SensoraMethod.h>
+#include <SensoraRouter.h>
+#include <SensoraInbox.h>
 #include <SensoraTransport.h>
+#include <SensoraLan.h>
+#include <SensoraOta.h>
 
 enum class DeviceState {
   Boot,
@@ -42,12 +53,48 @@ enum class DeviceState {
   SyncPropertyInfo,
   SyncDeviceStats,
   SyncPropertyState,
+
+  Sleep,
+};
+
+#ifdef RTC_DATA_ATTR
+#define SENSORA_RTC_ATTR RTC_DATA_ATTR
+#else
+#define SENSORA_RTC_ATTR
+#endif
+
+#define SENSORA_RTC_MAGIC 0x53524302
+
+struct DeviceService {
+  void (*poll)(void*);
+  void* arg;
+};
+
+struct BatchAck {
+  char id[SENSORA_MAX_BATCH_ID_LEN];
+  uint8_t accepted;
+  const char* error;
+};
+
+// survives deep sleep, timestamps are on a clock that keeps counting while asleep
+struct SensoraRtcState {
+  uint32_t magic;
+  uint8_t propertyCount;
+  bool infoSynced;
+  unsigned long clockMs;
+  // slots are matched to properties by Property::idCrc(), the list order
+  // can change between boots
+  uint32_t idCrc[DEVICE_MAX_PROPERTIES];
+  unsigned long cloudSyncedAt[DEVICE_MAX_PROPERTIES];
+  char cloudValue[DEVICE_MAX_PROPERTIES][PROPERTY_BUFFER_SIZE];
 };
+SENSORA_RTC_ATTR SensoraRtcState sensoraRtc;
 
-template <class Board>
+template <class Board, class Transport = Transp>
 class SensoraDevice {
  public:
-  SensoraDevice(Transp& transp) : transp(transp), state(DeviceState::Boot), st(DeviceStatus::Boot), bootedAt(millis()) {
+  SensoraDevice(Transport& transp) : transp(transp), state(DeviceState::Boot), st(DeviceStatus::Boot), ackCount(0), groupCount(0), broadcast(false), routesChanged(true), bootedAt(millis()), onlineAfterMs(0), sessionSynced(false), infoSynced(false), sleepSeconds(0), syncTaskRunning(false), infoCursor(0), stateCursor(0), syncPending(false), serviceCount(0) {
+    rateLimit.begin(DEVICE_RATE_LIMIT, DEVICE_RATE_BURST);
   }
 
   void setup() {
@@ -59,13 +106,82 @@ class SensoraDevice {
       setState(DeviceState::Provision);
     } else {
       SENSORA_LOGI("Running normal mode");
+      restoreProperties();
       setState(DeviceState::ConnectNetwork);
-      printLogo();
+      if (board.wokeFromSleep() && restoreRtcState()) {
+        SENSORA_LOGI("woke from deep sleep");
+      } else {
+        printLogo();
+      }
+#ifdef SENSORA_DUAL_CORE
+      syncTaskRunning = board.startSyncTask(syncStep, this);
+      if (!syncTaskRunning) {
+        SENSORA_LOGE("failed to start sync task, running on a single core");
+      }
+#endif
+    }
+  }
+
+  // also receive writes sent to sc/group/<group>/msg/recv, group must outlive
+  // the device. May be called while connected, the topic is subscribed on
+  // the next sync step
+  bool joinGroup(const char* group) {
+    if (groupCount >= SENSORA_MAX_GROUPS) {
+      return false;
     }
+    groups[groupCount] = group;
+    groupCount = groupCount + 1;
+    routesChanged = true;
+    return true;
+  }
+
+  // called once per multi-property write instead of the property callbacks,
+  // after all values of the batch are stored
+  void onBatch(PropertyInbox::BatchCb cb) {
+    inbox.onBatch(cb);
   }
 
+  // also receive writes sent to every device on sc/broadcast/msg/recv
+  void enableBroadcast() {
+    broadcast = true;
+    routesChanged = true;
+  }
+
+  // caps state publishes of all properties together, Critical properties
+  // are not limited
+  void setRateLimit(float perSecond, uint8_t burst) {
+    rateLimit.begin(perSecond, burst);
+  }
+
+  // wake, connect, flush pending property values and deep sleep again,
+  // going back to sleep after maxAwakeMs even if the cloud is unreachable
+  void setSleepCycle(unsigned long seconds, unsigned long maxAwakeMs = 30000) {
+    sleepSeconds = seconds;
+    sleepMaxAwakeMs = maxAwakeMs;
+  }
+
+  // with SENSORA_DUAL_CORE loop() only delivers inbound writes, networking
+  // and storage run in runSync() on the task started by the board
   void loop() {
+    inbox.dispatch(DEVICE_INBOX_BUDGET_US);
+    if (!syncTaskRunning) {
+      runSync();
+    }
+  }
+
+  void runSync() {
+    board.loop();
+    if (state != DeviceState::Provision && routesChanged.exchange(false)) {
+      rebuildRoutes();
+    }
     DeviceState newState = state;
+    if (sleepSeconds > 0 && state != DeviceState::Provision && millis() - bootedAt >= sleepMaxAwakeMs) {
+      SENSORA_LOGW("awake for too long, going back to sleep");
+      setState(DeviceState::Sleep);
+    }
+    if (infoSynced && transp.connected()) {
+      publishUrgent();
+    }
     switch (state) {
       case DeviceState::Boot:
         break;
@@ -108,50 +224,109 @@ class SensoraDevice {
       case DeviceState::SyncPropertyState:
         newState = handleSyncPropertyState();
         break;
+      case DeviceState::Sleep:
+        newState = handleSleep();
+        break;
       default:
         break;
     }
     setState(newState);
     if (transp.connected()) {
-      transp.mqtt().poll();
+      transp.poll();
+    }
+    for (uint8_t i = 0; i < serviceCount; i++) {
+      services[i].poll(services[i].arg);
     }
+    persistProperties();
   }
 
   DeviceStatus status() { return st; }
 
   void handleMessage(int length) {
     uint8_t bytes[length];
-    String topic = transp.mqtt().messageTopic();
-    char deviceId[SENSORA_MAX_DEVICE_ID_LEN];
+    const char* topic = transp.messageTopic();
     for (int i = 0; i < length; i++) {
-      bytes[i] = transp.mqtt().read();
+      bytes[i] = transp.read();
     }
 
-    extractDeviceId(topic.c_str(), deviceId);
-    if (strcmp(deviceId, deviceConfig.deviceId) != 0) {
-      SENSORA_LOGW("invalid device id");
+    const RouteNode* route = router.match(topic);
+    if (route == nullptr) {
+      SENSORA_LOGW("no route for topic '%s'", topic);
       return;
     }
-    char propertyId[SENSORA_MAX_PROPERTY_ID_LEN];
-    if (!extractPayload(bytes, length, "id", propertyId, sizeof(propertyId))) {
-      SENSORA_LOGW("property id not found in payload");
+    if (route->kind == RouteKind::Batch) {
+      handleBatch(bytes, length);
       return;
     }
-    char propertyValue[PROPERTY_BUFFER_SIZE];
-    if (!extractPayload(bytes, length, "value", propertyValue, sizeof(propertyValue))) {
-      SENSORA_LOGW("property value not found in payload");
+    if (route->kind == RouteKind::Call) {
+      handleCall(bytes, length);
       return;
     }
-    Property* prop = propertyList.findById(propertyId);
+    Property* prop = route->prop;
+    char propertyValue[PROPERTY_BUFFER_SIZE];
+    if (route->kind == RouteKind::Property) {
+      size_t len = length < PROPERTY_BUFFER_SIZE ? length : PROPERTY_BUFFER_SIZE - 1;
+      memcpy(propertyValue, bytes, len);
+      propertyValue[len] = '\0';
+    } else {
+      char propertyId[SENSORA_MAX_PROPERTY_ID_LEN];
+      if (!extractPayload(bytes, length, "id", propertyId, sizeof(propertyId))) {
+        SENSORA_LOGW("property id not found in payload");
+        return;
+      }
+      if (!extractPayload(bytes, length, "value", propertyValue, sizeof(propertyValue))) {
+        SENSORA_LOGW("property value not found in payload");
+        return;
+      }
+      prop = propertyList.findById(propertyId);
+    }
     if (prop == nullptr) {
       SENSORA_LOGW("property not found");
       return;
     }
+    size_t len = strlen(propertyValue);
+    if (writeProperty(prop, propertyValue, len) == nullptr) {
+      prop->onCloudSynced(propertyValue, len);
+    }
+  }
+
+  // queues a write after the access checks every inbound path applies,
+  // returns why the write was refused or nullptr once it is queued
+  const char* writeProperty(Property* prop, const char* value, size_t len) {
     if (prop->getAccessMode() == AccessMode::Read) {
       SENSORA_LOGW("cannot update property '%s' because access mode is read only", prop->ID());
-      return;
+      return "read_only";
+    }
+    if (!prop->accepts(value)) {
+      SENSORA_LOGW("invalid value for property '%s'", prop->ID());
+      return "invalid_value";
+    }
+    if (!inbox.push(prop, value, len)) {
+      SENSORA_LOGW("inbox full, dropped write to property '%s'", prop->ID());
+      return "inbox_full";
+    }
+    return nullptr;
+  }
+
+  // polled from the sync loop whatever the cloud connection state, used by
+  // the LAN endpoint and firmware updates
+  bool attachService(void (*poll)(void*), void* arg) {
+    if (serviceCount >= SENSORA_MAX_SERVICES) {
+      SENSORA_LOGE("Maximum services reached. Please change SENSORA_MAX_SERVICES");
+      return false;
     }
-    prop->onMessage(propertyValue, strlen(propertyValue));
+    services[serviceCount++] = {poll, arg};
+    return true;
+  }
+
+  // publishes on sc/<id>/<subtopic>, only from the sync loop
+  bool publish(const char* subtopic, SensoraPayload& payload) {
+    if (!transp.connected()) {
+      return false;
+    }
+    char topic[SENSORA_MAX_TOPIC_LEN];
+    snprintf(topic, sizeof(topic), "sc/%s/%s", deviceConfig.deviceId, subtopic);
+    return transp.publish(topic, payload.buffer(), payload.length());
   }
 
   void addAttribute(const char* key, const char* value) {
@@ -159,30 +334,104 @@ class SensoraDevice {
 
  protected:
   Board board;
-  Transp& transp;
+  Transport& transp;
 
  private:
   DeviceState state;
   DeviceStatus st;
+  PropertyInbox inbox;
+  TopicRouter router;
+  BatchAck acks[SENSORA_MAX_PENDING_ACKS];
+  uint8_t ackCount;
+  const char* groups[SENSORA_MAX_GROUPS];
+  std::atomic<uint8_t> groupCount;
+  bool broadcast;
+  std::atomic<bool> routesChanged;
   void setState(DeviceState s) { state = s; }
   void setStatus(DeviceStatus s) { st = s; }
   unsigned long waitTimer;
   unsigned long bootedAt;
   unsigned long statSyncedAt;
+  unsigned long onlineAfterMs;
+  bool sessionSynced;
+  bool infoSynced;
+  unsigned long sleepSeconds;
+  unsigned long sleepMaxAwakeMs;
+  bool syncTaskRunning;
+  TokenBucket rateLimit;
+  int infoCursor;
+  int stateCursor;
+  bool syncPending;
+  DeviceService services[SENSORA_MAX_SERVICES];
+  uint8_t serviceCount;
 
   uint32_t uptimeSeconds() const {
     return (millis() - bootedAt) / 1000ULL;
   }
 
+  uint32_t rateSuppressed() {
+    uint32_t count = 0;
+    for (Property* prop : propertyList) {
+      if (prop != nullptr) {
+        count += prop->rateSuppressed();
+      }
+    }
+    return count;
+  }
+
+  uint32_t sampleDrops() {
+    uint32_t drops = 0;
+    for (Property* prop : propertyList) {
+      if (prop != nullptr) {
+        drops += prop->sampleDrops();
+      }
+    }
+    return drops;
+  }
+
+  void restoreProperties() {
+    char key[10];
+    PropertyRecord record;
+    for (Property* prop : propertyList) {
+      if (prop == nullptr || !prop->isPersistent()) {
+        continue;
+      }
+      prop->persistKey(key, sizeof(key));
+      if (board.readConfig(key, record) && record.len < PROPERTY_BUFFER_SIZE) {
+        SENSORA_LOGD("restored property '%s'", prop->ID());
+        prop->restore(record);
+      }
+    }
+  }
+
+  void persistProperties() {
+    char key[10];
+    PropertyRecord record;
+    for (Property* prop : propertyList) {
+      if (prop == nullptr || !prop->isPersistent()) {
+        continue;
+      }
+      memset(&record, 0, sizeof(PropertyRecord));
+      record.len = prop->snapshot(record.value);
+      if (!prop->shouldPersist(record.value, record.len)) {
+        continue;
+      }
+      prop->persistKey(key, sizeof(key));
+      board.writeConfig(key, record);
+      prop->onPersisted();
+    }
+  }
+
   DeviceState handleWaitNetworkConn() {
     if (waitTimer == 0) {
       waitTimer = millis();
     }
     if (board.isNetworkConnected()) {
       waitTimer = 0;
+      board.onNetworkConnected();
       return DeviceState::ConnectMqtt;
     }
-    if (millis() - waitTimer >= 10000LU) {
+    if (millis() - waitTimer >= board.networkConnTimeout()) {
       waitTimer = 0;
       return DeviceState::NetworkConnFailure;
     }
@@ -191,14 +440,12 @@ class SensoraDevice {
 
   DeviceState handleConnectMqtt() {
     if (transp.connected()) {
-      setStatus(DeviceStatus::Online);
-      return DeviceState::SubscribeMqtt;
+      return handleMqttConnected();
     }
-    transp.mqtt().onMessage(onMessage);
+    transp.onMessage(onMessage);
     transp.setup();
     if (transp.connect()) {
-      setStatus(DeviceStatus::Online);
-      return DeviceState::SubscribeMqtt;
+      return handleMqttConnected();
     }
     return DeviceState::WaitMqttConn;
   }
@@ -209,7 +456,8 @@ class SensoraDevice {
     }
 
     if (transp.connected()) {
-      return DeviceState::SubscribeMqtt;
+      waitTimer = 0;
+      return handleMqttConnected();
     }
     if (millis() - waitTimer >= 10000LU) {
       return DeviceState::MqttConnFailure;
@@ -217,18 +465,269 @@ class SensoraDevice {
     return DeviceState::WaitMqttConn;
   }
 
+  DeviceState handleMqttConnected() {
+    setStatus(DeviceStatus::Online);
+    if (onlineAfterMs == 0) {
+      onlineAfterMs = millis() - bootedAt;
+      SENSORA_LOGI("online %lu ms after boot", onlineAfterMs);
+    }
+    if (!sessionSynced || !transp.sessionPresent()) {
+      sessionSynced = false;
+      return DeviceState::SubscribeMqtt;
+    }
+    // broker kept our subscription and the cloud already has device and
+    // property info, publish pending values and refresh the status right after
+    SENSORA_LOGI("resuming mqtt session");
+    statSyncedAt = millis() - DEVICE_STATS_SYNC_INTERVAL_MS;
+    return DeviceState::SyncPropertyState;
+  }
+
+  // validates every pair of batch=<id>;<prop>=<value>;... and queues all
+  // writes together or none of them, the result is acked on sc/<id>/msg/ack
+  void handleBatch(const uint8_t* bytes, int length) {
+    BatchAck ack;
+    if (!extractPayload(bytes, length, "batch", ack.id, sizeof(ack.id))) {
+      SENSORA_LOGW("batch id not found in payload");
+      return;
+    }
+    ack.error = nullptr;
+    uint8_t count = 0;
+    size_t capacity = inbox.batchCapacity();
+    int i = 0;
+    while (i < length && ack.error == nullptr) {
+      int keyStart = i;
+      while (i < length && bytes[i] != '=' && bytes[i] != ';') {
+        i++;
+      }
+      int keyLen = i - keyStart;
+      if (i >= length || bytes[i] != '=') {
+        i++;
+        continue;
+      }
+      int valueStart = ++i;
+      while (i < length && bytes[i] != ';') {
+        i++;
+      }
+      int valueLen = i++ - valueStart;
+      if (keyLen == 5 && memcmp(bytes + keyStart, "batch", 5) == 0) {
+        continue;
+      }
+
+      char propertyId[SENSORA_MAX_PROPERTY_ID_LEN];
+      if (keyLen >= static_cast<int>(sizeof(propertyId))) {
+        ack.error = "unknown_property";
+        break;
+      }
+      if (count >= capacity) {
+        ack.error = "inbox_full";
+        break;
+      }
+      memcpy(propertyId, bytes + keyStart, keyLen);
+      propertyId[keyLen] = '\0';
+      Property* prop = propertyList.findById(propertyId);
+      PropertyWrite& w = inbox.batchSlot(count);
+      w.len = valueLen < PROPERTY_BUFFER_SIZE ? valueLen : PROPERTY_BUFFER_SIZE - 1;
+      memcpy(w.value, bytes + valueStart, w.len);
+      w.value[w.len] = '\0';
+      w.prop = prop;
+      if (prop == nullptr) {
+        ack.error = "unknown_property";
+      } else if (prop->getAccessMode() == AccessMode::Read) {
+        ack.error = "read_only";
+      } else if (!prop->accepts(w.value)) {
+        ack.error = "invalid_value";
+      } else {
+        count++;
+      }
+    }
+    if (ack.error == nullptr && count > 0) {
+      for (uint8_t j = 0; j < count; j++) {
+        PropertyWrite& w = inbox.batchSlot(j);
+        w.prop->onCloudSynced(w.value, w.len);
+      }
+      inbox.commitBatch(count);
+    }
+    ack.accepted = ack.error == nullptr ? count : 0;
+    if (ackCount >= SENSORA_MAX_PENDING_ACKS) {
+      SENSORA_LOGW("dropped ack of batch '%s'", ack.id);
+      return;
+    }
+    acks[ackCount++] = ack;
+  }
+
+  // runs the method and publishes its response straight away, the call id
+  // lets the caller pipeline requests and match responses out of order.
+  // This publishes from inside the transport's message callback. That is
+  // safe because handleMessage() has already copied the payload out, and
+  // MqttSnTransport queues anything that arrives meanwhile until poll()
+  void handleCall(const uint8_t* bytes, int length) {
+    char callId[SENSORA_MAX_CALL_ID_LEN];
+    if (!extractPayload(bytes, length, "cid", callId, sizeof(callId))) {
+      SENSORA_LOGW("call id not found in payload");
+      return;
+    }
+    SensoraPayload response;
+    response.add("cid", callId);
+    char name[SENSORA_MAX_PROPERTY_ID_LEN];
+    Method* method = nullptr;
+    if (extractPayload(bytes, length, "method", name, sizeof(name))) {
+      method = methodList.findByName(name);
+    }
+    if (method == nullptr) {
+      response.add("error", "unknown_method");
+    } else if (!method->call(bytes, length, response)) {
+      response.add("error", "failed");
+    }
+    char topic[SENSORA_MAX_TOPIC_LEN];
+    snprintf(topic, sizeof(topic), "sc/%s/rpc/res", deviceConfig.deviceId);
+    if (!transp.publish(topic, response.buffer(), response.length())) {
+      SENSORA_LOGW("failed to respond to call '%s'", callId);
+    }
+  }
+
+  bool publishAcks() {
+    if (ackCount == 0) {
+      return true;
+    }
+    char topic[SENSORA_MAX_TOPIC_LEN];
+    snprintf(topic, sizeof(topic), "sc/%s/msg/ack", deviceConfig.deviceId);
+    SensoraPayload payload;
+    while (ackCount > 0) {
+      BatchAck& ack = acks[0];
+      payload.add("batch", ack.id);
+      payload.add("accepted", ack.accepted);
+      if (ack.error != nullptr) {
+        payload.add("error", ack.error);
+      }
+      if (!transp.publish(topic, payload.buffer(), payload.length())) {
+        return false;
+      }
+      payload.clear();
+      memmove(acks, acks + 1, --ackCount * sizeof(BatchAck));
+    }
+    return true;
+  }
+
+  // routes for sc/<id>/msg/recv, sc/<id>/prop/<prop>/set,
+  // sc/<id>/node/<node>/<prop>/set and the group and broadcast topics
+  void buildRoutes() {
+    router.clear();
+    RouteNode* sc = router.top("sc");
+    RouteNode* dev = router.insert(sc, deviceConfig.deviceId);
+    addPayloadRoute(dev);
+    RouteNode* batch = router.insert(router.insert(dev, "msg"), "batch");
+    if (batch != nullptr) {
+      batch->kind = RouteKind::Batch;
+    }
+    RouteNode* call = router.insert(router.insert(dev, "rpc"), "req");
+    if (call != nullptr) {
+      call->kind = RouteKind::Call;
+    }
+    for (Property* prop : propertyList) {
+      if (prop == nullptr || prop->getAccessMode() == AccessMode::Read) {
+        continue;
+      }
+      RouteNode* scope = strlen(prop->nodeId()) == 0 ? router.insert(dev, "prop") : router.insert(router.insert(dev, "node"), prop->nodeId());
+      RouteNode* set = router.insert(router.insert(scope, prop->ID()), "set");
+      if (set != nullptr) {
+        set->kind = RouteKind::Property;
+        set->prop = prop;
+      }
+    }
+    for (uint8_t i = 0; i < groupCount; i++) {
+      addPayloadRoute(router.insert(router.insert(sc, "group"), groups[i]));
+    }
+    if (broadcast) {
+      addPayloadRoute(router.insert(sc, "broadcast"));
+    }
+  }
+
+  // runs on the sync task so that no message is routed while the router is
+  // rebuilt. The first build also serves a resumed session, which skips
+  // SubscribeMqtt, later ones subscribe again to pick up the new topics
+  void rebuildRoutes() {
+    bool built = !router.empty();
+    buildRoutes();
+    if (!built) {
+      return;
+    }
+    sessionSynced = false;
+    if (state == DeviceState::SyncDeviceInfo || state == DeviceState::SyncPropertyInfo ||
+        state == DeviceState::SyncDeviceStats || state == DeviceState::SyncPropertyState) {
+      setState(DeviceState::SubscribeMqtt);
+    }
+  }
+
+  void addPayloadRoute(RouteNode* parent) {
+    RouteNode* recv = router.insert(router.insert(parent, "msg"), "recv");
+    if (recv != nullptr) {
+      recv->kind = RouteKind::Payload;
+    }
+  }
+
+  bool subscribe(const char* topic) {
+    SENSORA_LOGI("subscribing to topic '%s'", topic);
+    if (!transp.subscribe(topic)) {
+      SENSORA_LOGE("Failed to subscribe to topic '%s'", topic);
+      return false;
+    }
+    return true;
+  }
+
   DeviceState handleSubscribeMqtt() {
     if (!transp.connected()) {
       return DeviceState::ConnectMqtt;
     }
-    char topic[45];
+    char topic[SENSORA_MAX_TOPIC_LEN];
     snprintf(topic, sizeof(topic), "sc/%s/msg/recv", deviceConfig.deviceId);
-    SENSORA_LOGI("subscribing to topic '%s'", topic);
-    if (!transp.subscribe(topic)) {
-      SENSORA_LOGE("Failed to subscribe to topic '%s'", topic);
+    if (!subscribe(topic)) {
+      return DeviceState::ConnectNetwork;
+    }
+    snprintf(topic, sizeof(topic), "sc/%s/msg/batch", deviceConfig.deviceId);
+    if (!subscribe(topic)) {
       return DeviceState::ConnectNetwork;
     }
-    SENSORA_LOGI("successfully subscribed to topic '%s'", topic);
+    snprintf(topic, sizeof(topic), "sc/%s/rpc/req", deviceConfig.deviceId);
+    if (!subscribe(topic)) {
+      return DeviceState::ConnectNetwork;
+    }
+    // one wildcard subscription per scope, the router resolves the property
+    const char* subscribed[DEVICE_MAX_PROPERTIES];
+    uint8_t scopes = 0;
+    for (Property* prop : propertyList) {
+      if (prop == nullptr || prop->getAccessMode() == AccessMode::Read) {
+        continue;
+      }
+      uint8_t i = 0;
+      while (i < scopes && strcmp(subscribed[i], prop->nodeId()) != 0) {
+        i++;
+      }
+      if (i < scopes) {
+        continue;
+      }
+      subscribed[scopes++] = prop->nodeId();
+      if (strlen(prop->nodeId()) == 0) {
+        snprintf(topic, sizeof(topic), "sc/%s/prop/+/set", deviceConfig.deviceId);
+      } else {
+        snprintf(topic, sizeof(topic), "sc/%s/node/%s/+/set", deviceConfig.deviceId, prop->nodeId());
+      }
+      if (!subscribe(topic)) {
+        return DeviceState::ConnectNetwork;
+      }
+    }
+    for (uint8_t i = 0; i < groupCount; i++) {
+      snprintf(topic, sizeof(topic), "sc/group/%s/msg/recv", groups[i]);
+      if (!subscribe(topic)) {
+        return DeviceState::ConnectNetwork;
+      }
+    }
+    if (broadcast && !subscribe("sc/broadcast/msg/recv")) {
+      return DeviceState::ConnectNetwork;
+    }
+    SENSORA_LOGI("successfully subscribed to device topics");
+    if (infoSynced) {
+      return DeviceState::SyncDeviceStats;
+    }
     return DeviceState::SyncDeviceInfo;
   }
 
@@ -241,6 +740,24 @@ class SensoraDevice {
     SensoraPayload payload;
     payload.add("fw_version", "1.0.0");
     board.readInfo(payload);
+    char methods[64];
+    size_t n = 0;
+    for (Method* method : methodList) {
+      size_t len = strlen(method->name());
+      if (n + len + 2 > sizeof(methods)) {
+        SENSORA_LOGW("method list too long for device info, '%s' and later methods are left out", method->name());
+        break;
+      }
+      if (n > 0) {
+        methods[n++] = ',';
+      }
+      memcpy(methods + n, method->name(), len);
+      n += len;
+    }
+    if (n > 0) {
+      methods[n] = '\0';
+      payload.add("methods", methods);
+    }
     if (!transp.publish(topic, payload.buffer(), payload.length())) {
       SENSORA_LOGE("failed to sync device info");
       return DeviceState::ConnectNetwork;
@@ -250,13 +767,18 @@ class SensoraDevice {
 
   DeviceState handleSyncPropertyInfo() {
     if (!transp.connected()) {
+      infoCursor = 0;
       return DeviceState::ConnectMqtt;
     }
     char topic[46];
     snprintf(topic, sizeof(topic), "sc/%s/prop/info", deviceConfig.deviceId);
     SensoraPayload payload;
-    for (Property* prop : propertyList) {
+    unsigned long start = micros();
+    uint8_t published = 0;
+    while (infoCursor < propertyList.count()) {
+      Property* prop = propertyList.begin()[infoCursor];
       if (prop == nullptr) {
+        infoCursor++;
         continue;
       }
       payload.add("id", prop->ID());
@@ -264,11 +786,21 @@ class SensoraDevice {
       payload.add("dataType", static_cast<uint8_t>(prop->getDataType()));
       payload.add("accessMode", static_cast<uint8_t>(prop->getAccessMode()));
       payload.add("syncStrategy", static_cast<uint8_t>(prop->getSyncStrategy()));
+      if (prop->getAggregation() != Aggregation::None) {
+        payload.add("aggregation", static_cast<uint8_t>(prop->getAggregation()));
+      }
+      prop->describe(payload);
       if (!transp.publish(topic, payload.buffer(), payload.length())) {
+        infoCursor = 0;
         return DeviceState::ConnectNetwork;
       }
       payload.clear();
+      infoCursor++;
+      if (syncBudgetSpent(start, ++published)) {
+        return DeviceState::SyncPropertyInfo;
+      }
     }
+    infoCursor = 0;
     return DeviceState::SyncDeviceStats;
   }
 
@@ -282,11 +814,19 @@ class SensoraDevice {
     SensoraPayload payload;
     payload.add("status", static_cast<uint8_t>(status()));
     payload.add("uptime", uptimeSeconds());
+    payload.add("online_ms", static_cast<uint32_t>(onlineAfterMs));
+    payload.add("handshake_ms", static_cast<uint32_t>(transp.handshakeMs()));
+    payload.add("inbox_depth", inbox.depth());
+    payload.add("inbox_drops", inbox.drops());
+    payload.add("sample_drops", sampleDrops());
+    payload.add("rate_suppressed", rateSuppressed());
     board.readStats(payload);
     if (!transp.publish(topic, payload.buffer(), payload.length())) {
       return DeviceState::ConnectNetwork;
     }
     statSyncedAt = millis();
+    sessionSynced = true;
+    infoSynced = true;
     return DeviceState::SyncPropertyState;
   }
 
@@ -294,32 +834,195 @@ class SensoraDevice {
     if (!transp.connected()) {
       return DeviceState::ConnectMqtt;
     }
-    char topic[44];
-    snprintf(topic, sizeof(topic), "sc/%s/msg/pub", deviceConfig.deviceId);
-    SensoraPayload payload;
-    for (Property* prop : propertyList) {
+    char value[PROPERTY_BUFFER_SIZE];
+    if (!publishAcks()) {
+      syncPending = true;
+    }
+    unsigned long start = micros();
+    uint8_t published = 0;
+    while (stateCursor < propertyList.count()) {
+      Property* prop = propertyList.begin()[stateCursor++];
       if (prop == nullptr) {
         continue;
       }
-      if (prop->shouldSync()) {
-        payload.add("id", prop->ID());
-        payload.add("value", prop->getBuff());
-        if (transp.publish(topic, payload.buffer(), payload.length())) {
-          prop->onCloudSynced();
+      prop->drainSamples();
+      size_t len = prop->snapshot(value);
+      if (prop->shouldSync(value)) {
+        if (!takeToken(prop)) {
+          // the newest value goes out once tokens refill
+          prop->onRateLimited(value, len);
+          syncPending = true;
         } else {
-          SENSORA_LOGE("failed to sync property state, id '%s'", prop->ID());
-          prop->onCloudSyncFailed();
+          published++;
+          if (!publishState(prop, value, len)) {
+            syncPending = true;
+          }
         }
       }
-      payload.clear();
+      if (prop->recordHistory(value)) {
+        published++;
+        if (!publishHistory(prop)) {
+          syncPending = true;
+        }
+      }
+      if (syncBudgetSpent(start, published)) {
+        break;
+      }
+    }
+    bool passDone = stateCursor >= propertyList.count();
+    if (passDone) {
+      stateCursor = 0;
     }
     if (millis() - statSyncedAt >= DEVICE_STATS_SYNC_INTERVAL_MS) {
       return DeviceState::SyncDeviceStats;
     }
+    if (passDone) {
+      // sleep only after a whole pass went out without failures
+      bool idle = !syncPending;
+      syncPending = false;
+      if (sleepSeconds > 0 && idle) {
+        return DeviceState::Sleep;
+      }
+    }
     return DeviceState::SyncPropertyState;
   }
 
+  bool publishState(Property* prop, const char* value, size_t len) {
+    char topic[44];
+    snprintf(topic, sizeof(topic), "sc/%s/msg/pub", deviceConfig.deviceId);
+    SensoraPayload payload;
+    payload.add("id", prop->ID());
+    payload.add("value", value);
+    if (!transp.publish(topic, payload.buffer(), payload.length())) {
+      SENSORA_LOGE("failed to sync property state, id '%s'", prop->ID());
+      prop->onCloudSyncFailed();
+      return false;
+    }
+    prop->onCloudSynced(value, len);
+    return true;
+  }
+
+  // Critical properties changed since the last loop(), the list is sorted
+  // by priority so they come first. A failed publish is retried by the
+  // regular state walk.
+  void publishUrgent() {
+    if (!propertyList.takeUrgent()) {
+      return;
+    }
+    char value[PROPERTY_BUFFER_SIZE];
+    for (Property* prop : propertyList) {
+      if (prop == nullptr || prop->getPriority() != Priority::Critical) {
+        break;
+      }
+      if (!prop->takeUrgent()) {
+        continue;
+      }
+      prop->drainSamples();
+      size_t len = prop->snapshot(value);
+      if (prop->shouldSync(value)) {
+        publishState(prop, value, len);
+      }
+    }
+  }
+
+  bool takeToken(Property* prop) {
+    if (prop->getPriority() == Priority::Critical) {
+      return true;
+    }
+    if (!prop->rateAvailable() || !rateLimit.available()) {
+      return false;
+    }
+    prop->takeRateToken();
+    rateLimit.take();
+    return true;
+  }
+
+  bool syncBudgetSpent(unsigned long start, uint8_t published) {
+    if (DEVICE_SYNC_MAX_PUBLISHES > 0 && published >= DEVICE_SYNC_MAX_PUBLISHES) {
+      return true;
+    }
+    return micros() - start >= DEVICE_SYNC_BUDGET_US;
+  }
+
+  bool publishHistory(Property* prop) {
+    char topic[46];
+    snprintf(topic, sizeof(topic), "sc/%s/prop/hist", deviceConfig.deviceId);
+    size_t len;
+    const uint8_t* batch = prop->historyBatch(len);
+    if (!transp.publish(topic, batch, len)) {
+      SENSORA_LOGE("failed to upload history of property '%s'", prop->ID());
+      return false;
+    }
+    prop->onHistorySent();
+    return true;
+  }
+
+  DeviceState handleSleep() {
+    setStatus(DeviceStatus::Sleeping);
+    if (transp.connected()) {
+      char topic[45];
+      snprintf(topic, sizeof(topic), "sc/%s/dev/info", deviceConfig.deviceId);
+      SensoraPayload payload;
+      payload.add("status", static_cast<uint8_t>(status()));
+      transp.publish(topic, payload.buffer(), payload.length());
+      transp.stop();
+    }
+    saveRtcState();
+    SENSORA_LOGI("deep sleep for %lu s", sleepSeconds);
+    board.deepSleep(sleepSeconds);
+    return DeviceState::Boot;
+  }
+
+  void saveRtcState() {
+    unsigned long clockMs = sensoraRtc.magic == SENSORA_RTC_MAGIC ? sensoraRtc.clockMs : 0;
+    uint8_t i = 0;
+    for (Property* prop : propertyList) {
+      unsigned long syncedAt = prop == nullptr ? 0 : prop->getCloudSyncedAt();
+      sensoraRtc.idCrc[i] = prop == nullptr ? 0 : prop->idCrc();
+      sensoraRtc.cloudSyncedAt[i] = syncedAt == 0 ? 0 : clockMs + syncedAt;
+      copyString(prop == nullptr ? "" : prop->getCloudValue(), sensoraRtc.cloudValue[i]);
+      i++;
+    }
+    sensoraRtc.propertyCount = i;
+    sensoraRtc.infoSynced = infoSynced;
+    sensoraRtc.clockMs = clockMs + millis() + sleepSeconds * 1000UL;
+    sensoraRtc.magic = SENSORA_RTC_MAGIC;
+  }
+
+  bool restoreRtcState() {
+    if (sensoraRtc.magic != SENSORA_RTC_MAGIC || sensoraRtc.propertyCount != propertyList.count()) {
+      sensoraRtc.magic = 0;
+      return false;
+    }
+    for (Property* prop : propertyList) {
+      if (prop == nullptr) {
+        continue;
+      }
+      uint32_t crc = prop->idCrc();
+      uint8_t i = 0;
+      while (i < sensoraRtc.propertyCount && sensoraRtc.idCrc[i] != crc) {
+        i++;
+      }
+      if (i == sensoraRtc.propertyCount) {
+        continue;
+      }
+      unsigned long syncedAt = sensoraRtc.cloudSyncedAt[i];
+      if (syncedAt != 0) {
+        // wraps around so that millis() - syncedAt is the real time since sync
+        syncedAt -= sensoraRtc.clockMs;
+        prop->restoreCloudState(sensoraRtc.cloudValue[i], syncedAt == 0 ? 1 : syncedAt);
+      }
+    }
+    infoSynced = sensoraRtc.infoSynced;
+    sessionSynced = infoSynced;
+    return true;
+  }
+
   static void onMessage(int len);
+
+  static void syncStep(void* device) {
+    static_cast<SensoraDevice*>(device)->runSync();
+  }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,292 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SensoraHistory_h
+#define SensoraHistory_h
+
+// Batch of numeric points compressed the way Gorilla does it: timestamps as
+// delta-of-delta in variable size buckets, values as the XOR with the
+// previous value. Layout of a sealed batch:
+//
+//   version:u8 idLen:u8 id[idLen] count:u16le firstAgeMs:u32le bits...
+//
+// firstAgeMs is how long before sealing the first point was taken, point
+// times in the bit stream are relative to the first point.
+#define HISTORY_VERSION 1
+// worst case size of one point, 36 bits of timestamp and 44 of value
+#define HISTORY_MAX_POINT_SIZE 10
+
+class HistoryEncoder {
+ public:
+  HistoryEncoder()
+      : buf(nullptr), size(0), start(0), bitPos(0), points(0), t0(0), prevTime(0), prevDelta(0), prevBits(0), prevLeading(0xff), prevTrailing(0) {}
+
+  void begin(uint8_t* storage, size_t storageSize, const char* id) {
+    buf = storage;
+    size = storageSize;
+    size_t idLen = strlen(id);
+    if (idLen > 255 || buf == nullptr || size < idLen + 8 + HISTORY_MAX_POINT_SIZE) {
+      buf = nullptr;
+      return;
+    }
+    buf[0] = HISTORY_VERSION;
+    buf[1] = idLen;
+    memcpy(buf + 2, id, idLen);
+    start = 2 + idLen + 6;
+    reset();
+  }
+
+  bool active() const { return buf != nullptr; }
+  uint16_t count() const { return points; }
+  uint32_t firstTime() const { return t0; }
+
+  void reset() {
+    points = 0;
+    bitPos = start * 8;
+    prevLeading = 0xff;
+  }
+
+  // false once the batch is full, t is in ms and must not go backwards
+  bool add(uint32_t t, float v) {
+    if (buf == nullptr || points == 0xffff || (bitPos + 7) / 8 + HISTORY_MAX_POINT_SIZE > size) {
+      return false;
+    }
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    if (points == 0) {
+      t0 = prevTime = t;
+      prevDelta = 0;
+      writeBits(bits, 32);
+    } else {
+      int32_t delta = t - prevTime;
+      writeTime(delta - prevDelta);
+      writeValue(bits ^ prevBits);
+      prevDelta = delta;
+      prevTime = t;
+    }
+    prevBits = bits;
+    points++;
+    return true;
+  }
+
+  // fills in the header, returns the number of bytes to send
+  size_t seal(uint32_t now) {
+    if (buf == nullptr || points == 0) {
+      return 0;
+    }
+    uint8_t* h = buf + start - 6;
+    uint32_t age = now - t0;
+    h[0] = points;
+    h[1] = points >> 8;
+    for (int i = 0; i < 4; i++) {
+      h[2 + i] = age >> (8 * i);
+    }
+    return (bitPos + 7) / 8;
+  }
+
+  const uint8_t* data() const { return buf; }
+
+ private:
+  uint8_t* buf;
+  size_t size;
+  size_t start;
+  size_t bitPos;
+  uint16_t points;
+  uint32_t t0;
+  uint32_t prevTime;
+  int32_t prevDelta;
+  uint32_t prevBits;
+  uint8_t prevLeading;
+  uint8_t prevTrailing;
+
+  void writeBits(uint32_t v, uint8_t n) {
+    while (n > 0) {
+      n--;
+      uint8_t mask = 0x80 >> (bitPos % 8);
+      if ((v >> n) & 1) {
+        buf[bitPos / 8] |= mask;
+      } else {
+        buf[bitPos / 8] &= ~mask;
+      }
+      bitPos++;
+    }
+  }
+
+  void writeTime(int32_t dod) {
+    if (dod == 0) {
+      writeBits(0, 1);
+    } else if (dod >= -64 && dod <= 63) {
+      writeBits(0x2, 2);
+      writeBits(dod, 7);
+    } else if (dod >= -256 && dod <= 255) {
+      writeBits(0x6, 3);
+      writeBits(dod, 9);
+    } else if (dod >= -2048 && dod <= 2047) {
+      writeBits(0xe, 4);
+      writeBits(dod, 12);
+    } else {
+      writeBits(0xf, 4);
+      writeBits(dod, 32);
+    }
+  }
+
+  void writeValue(uint32_t x) {
+    if (x == 0) {
+      writeBits(0, 1);
+      return;
+    }
+    uint8_t leading = __builtin_clz(x);
+    uint8_t trailing = __builtin_ctz(x);
+    if (prevLeading != 0xff && leading >= prevLeading && trailing >= prevTrailing) {
+      // fits into the previous meaningful window
+      writeBits(0x2, 2);
+      writeBits(x >> prevTrailing, 32 - prevLeading - prevTrailing);
+      return;
+    }
+    uint8_t meaningful = 32 - leading - trailing;
+    writeBits(0x3, 2);
+    writeBits(leading, 5);
+    writeBits(meaningful - 1, 5);
+    writeBits(x >> trailing, meaningful);
+    prevLeading = leading;
+    prevTrailing = trailing;
+  }
+};
+
+class HistoryDecoder {
+ public:
+  HistoryDecoder(const uint8_t* batch, size_t len)
+      : buf(batch), size(len), idLen(0), bitPos(0), points(0), read(0), age(0), valid(false), prevTime(0), prevDelta(0), prevBits(0), prevLeading(0), prevTrailing(0) {
+    if (batch == nullptr || len < 8 || batch[0] != HISTORY_VERSION || len < 2u + batch[1] + 6) {
+      return;
+    }
+    idLen = batch[1];
+    const uint8_t* h = batch + 2 + idLen;
+    points = h[0] | (h[1] << 8);
+    for (int i = 0; i < 4; i++) {
+      age |= static_cast<uint32_t>(h[2 + i]) << (8 * i);
+    }
+    bitPos = (2 + idLen + 6) * 8;
+    valid = true;
+  }
+
+  bool isValid() const { return valid; }
+  uint16_t count() const { return points; }
+  uint32_t firstAgeMs() const { return age; }
+
+  // copies the property id into out, cut to fit, empty for an invalid batch
+  void propertyId(char* out, size_t outSize) const {
+    if (outSize == 0) {
+      return;
+    }
+    if (!valid) {
+      out[0] = '\0';
+      return;
+    }
+    size_t n = idLen < outSize - 1 ? idLen : outSize - 1;
+    memcpy(out, buf + 2, n);
+    out[n] = '\0';
+  }
+
+  // t is the offset in ms from the first point
+  bool next(uint32_t& t, float& v) {
+    if (!valid || read >= points) {
+      return false;
+    }
+    if (read == 0) {
+      prevTime = 0;
+      prevDelta = 0;
+      prevBits = readBits(32);
+    } else {
+      int32_t delta = prevDelta + readTime();
+      prevTime += delta;
+      prevDelta = delta;
+      prevBits ^= readValue();
+    }
+    if (bitPos > size * 8) {
+      valid = false;
+      return false;
+    }
+    t = prevTime;
+    memcpy(&v, &prevBits, sizeof(v));
+    read++;
+    return true;
+  }
+
+ private:
+  const uint8_t* buf;
+  size_t size;
+  size_t idLen;
+  size_t bitPos;
+  uint16_t points;
+  uint16_t read;
+  uint32_t age;
+  bool valid;
+  uint32_t prevTime;
+  int32_t prevDelta;
+  uint32_t prevBits;
+  uint8_t prevLeading;
+  uint8_t prevTrailing;
+
+  uint32_t readBits(uint8_t n) {
+    uint32_t v = 0;
+    while (n > 0) {
+      n--;
+      uint32_t bit = 0;
+      if (bitPos < size * 8) {
+        bit = (buf[bitPos / 8] >> (7 - bitPos % 8)) & 1;
+      }
+      v = (v << 1) | bit;
+      bitPos++;
+    }
+    return v;
+  }
+
+  static int32_t signExtend(uint32_t v, uint8_t bits) {
+    uint32_t m = 1u << (bits - 1);
+    return static_cast<int32_t>((v ^ m) - m);
+  }
+
+  int32_t readTime() {
+    if (readBits(1) == 0) {
+      return 0;
+    }
+    if (readBits(1) == 0) {
+      return signExtend(readBits(7), 7);
+    }
+    if (readBits(1) == 0) {
+      return signExtend(readBits(9), 9);
+    }
+    if (readBits(1) == 0) {
+      return signExtend(readBits(12), 12);
+    }
+    return static_cast<int32_t>(readBits(32));
+  }
+
+  uint32_t readValue() {
+    if (readBits(1) == 0) {
+      return 0;
+    }
+    if (readBits(1) == 1) {
+      prevLeading = readBits(5);
+      uint8_t meaningful = readBits(5) + 1;
+      prevTrailing = 32 - prevLeading - meaningful;
+    }
+    return readBits(32 - prevLeading - prevTrailing) << prevTrailing;
+  }
+};
+
+#endif
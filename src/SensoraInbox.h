@@ -0,0 +1,129 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SensoraInbox_h
+#define SensoraInbox_h
+
+// Inbound property writes received while polling the transport. Callbacks run
+// later from loop() so a slow callback cannot stall MQTT processing. With
+// SENSORA_DUAL_CORE the transport is polled on another core and this is the
+// only path values take into the application.
+class PropertyInbox {
+ public:
+  typedef void (*BatchCb)(Property** props, uint8_t count);
+
+  PropertyInbox() : dropCount(0), batchCb(nullptr) {}
+
+  // runs once per batch instead of the property callbacks
+  void onBatch(BatchCb cb) { batchCb = cb; }
+
+  bool push(Property* prop, const char* value, size_t len) {
+    if (len >= PROPERTY_BUFFER_SIZE) {
+      len = PROPERTY_BUFFER_SIZE - 1;
+    }
+#ifndef SENSORA_DUAL_CORE
+    // a newer write to the same property replaces the queued one
+    for (size_t i = 0; i < queue.size(); i++) {
+      PropertyWrite& w = queue.at(i);
+      if (w.prop == prop && w.batch == 0) {
+        memcpy(w.value, value, len);
+        w.len = len;
+        return true;
+      }
+    }
+#endif
+    PropertyWrite w;
+    w.prop = prop;
+    memcpy(w.value, value, len);
+    w.len = len;
+    w.batch = 0;
+    if (!queue.push(w)) {
+      dropCount++;
+      return false;
+    }
+    prop->onInboxPushed();
+    return true;
+  }
+
+  // Writes of a batch are staged with batchSlot() and queued together by
+  // commitBatch(), the consumer never sees part of a batch.
+  size_t batchCapacity() const {
+    size_t n = queue.space();
+    return n < 255 ? n : 255;
+  }
+
+  PropertyWrite& batchSlot(size_t i) { return queue.slot(i); }
+
+  void commitBatch(uint8_t n) {
+    for (uint8_t i = 0; i < n; i++) {
+      PropertyWrite& w = queue.slot(i);
+      w.batch = n - i;
+      w.prop->onInboxPushed();
+    }
+    queue.commit(n);
+  }
+
+  // runs queued callbacks until the queue is empty or budgetUs has passed,
+  // at least one write is dispatched per call
+  void dispatch(unsigned long budgetUs) {
+    unsigned long start = micros();
+    PropertyWrite w;
+    while (queue.pop(w)) {
+      if (w.batch > 0) {
+        dispatchBatch(w);
+      } else if (w.prop->onInboxPopped() <= 0) {
+        // only the last of several queued writes to a property is applied
+        w.prop->onMessage(w.value, w.len);
+      }
+      if (micros() - start >= budgetUs) {
+        break;
+      }
+    }
+  }
+
+  uint8_t depth() const { return queue.size(); }
+  uint32_t drops() const { return dropCount; }
+
+ private:
+  SpscQueue<PropertyWrite, DEVICE_INBOX_SIZE> queue;
+  std::atomic<uint32_t> dropCount;
+  BatchCb batchCb;
+
+  // commits every value of the batch before any callback runs. Unlike single
+  // writes none is skipped for a newer queued one, that could be part of a
+  // batch still being committed and the callback would see half of each
+  void dispatchBatch(PropertyWrite& w) {
+    Property* props[DEVICE_INBOX_SIZE];
+    uint8_t count = 0;
+    for (uint8_t left = w.batch; left > 0; left--) {
+      w.prop->onInboxPopped();
+      w.prop->apply(w.value, w.len);
+      props[count++] = w.prop;
+      if (left > 1 && !queue.pop(w)) {
+        break;
+      }
+    }
+    if (batchCb != nullptr) {
+      batchCb(props, count);
+      return;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+      props[i]->notify();
+    }
+  }
+};
+
+#endif
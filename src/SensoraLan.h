@@ -0,0 +1,242 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SensoraLan_h
+#define SensoraLan_h
+
+#ifndef SENSORA_LAN_PORT
+#define SENSORA_LAN_PORT 5683
+#endif
+
+// packets handled per sync step, the rest wait for the next one
+#ifndef SENSORA_LAN_MAX_PACKETS
+#define SENSORA_LAN_MAX_PACKETS 4
+#endif
+
+// controllers that can hold a session at the same time
+#ifndef SENSORA_LAN_MAX_SESSIONS
+#define SENSORA_LAN_MAX_SESSIONS 4
+#endif
+
+#define LAN_MAC_SIZE 16
+
+struct LanSession {
+  char nonce[9];
+  uint32_t lastSeq;
+  unsigned long usedAt;
+};
+
+// UDP endpoint for reading and writing properties from the local network
+// without going through the cloud, it keeps working while the internet is
+// down. Requests are key=value payloads like the MQTT ones:
+//
+//   op=hello                                  -> nonce=<hex>
+//   nonce=<hex>;seq=<n>;op=get;id=<prop>;mac=<hex>
+//   nonce=<hex>;seq=<n>;op=set;id=<prop>;value=<v>;mac=<hex>
+//
+// mac is the first 16 bytes of HMAC-SHA256 over everything before ";mac=",
+// keyed with HMAC-SHA256(deviceToken, "sensora-lan"). Every hello opens a
+// session with a new nonce and seq must grow with every request of that
+// session, so a captured packet cannot be replayed. Each controller keeps
+// its own session. Past SENSORA_LAN_MAX_SESSIONS a hello replaces the
+// session idle the longest, its requests then fail with stale_nonce until
+// that controller says hello again. Responses carry the same seq and are
+// signed the same way with HMAC-SHA256(deviceToken, "sensora-lan-resp"), so
+// a request can never pass for a response. Writes go through the same
+// access checks as cloud writes.
+template <typename TUdp, typename TDevice>
+class LanEndpoint {
+ public:
+  LanEndpoint(TUdp& udp, TDevice& device, uint16_t port = SENSORA_LAN_PORT)
+      : udp(udp), device(device), port(port), started(false) {
+    device.attachService(step, this);
+  }
+
+ private:
+  TUdp& udp;
+  TDevice& device;
+  uint16_t port;
+  bool started;
+  uint8_t secret[SHA256_SIZE];
+  uint8_t responseSecret[SHA256_SIZE];
+  LanSession sessions[SENSORA_LAN_MAX_SESSIONS];
+  uint8_t packet[SENSORA_PAYLOAD_SIZE];
+
+  static void step(void* arg) {
+    static_cast<LanEndpoint*>(arg)->poll();
+  }
+
+  void poll() {
+    if (!started && !start()) {
+      return;
+    }
+    for (int i = 0; i < SENSORA_LAN_MAX_PACKETS && udp.parsePacket() > 0; i++) {
+      int len = udp.read(packet, sizeof(packet));
+      if (len > 0) {
+        handlePacket(len);
+      }
+    }
+  }
+
+  bool start() {
+    size_t tokenLen = strlen(deviceConfig.deviceToken);
+    if (tokenLen == 0 || !udp.begin(port)) {
+      return false;
+    }
+    deriveKey(tokenLen, "sensora-lan", secret);
+    deriveKey(tokenLen, "sensora-lan-resp", responseSecret);
+    for (LanSession& session : sessions) {
+      session.nonce[0] = '\0';
+    }
+    started = true;
+    SENSORA_LOGI("LAN endpoint listening on port %u", port);
+    return true;
+  }
+
+  void deriveKey(size_t tokenLen, const char* label, uint8_t* key) {
+    hmacSha256(reinterpret_cast<const uint8_t*>(deviceConfig.deviceToken), tokenLen,
+               reinterpret_cast<const uint8_t*>(label), strlen(label), key);
+  }
+
+  void handlePacket(int len) {
+    SensoraPayload response;
+    char op[8];
+    if (!extractPayload(packet, len, "op", op, sizeof(op))) {
+      return;
+    }
+    if (strcmp(op, "hello") == 0) {
+      response.add("nonce", openSession().nonce);
+      reply(response, false);
+      return;
+    }
+
+    char seq[12];
+    if (!extractPayload(packet, len, "seq", seq, sizeof(seq))) {
+      return;
+    }
+    response.add("seq", seq);
+    const char* error = authenticate(len, seq);
+    char id[SENSORA_MAX_PROPERTY_ID_LEN];
+    char value[PROPERTY_BUFFER_SIZE];
+    Property* prop = nullptr;
+    if (error == nullptr) {
+      if (!extractPayload(packet, len, "id", id, sizeof(id)) || (prop = propertyList.findById(id)) == nullptr) {
+        error = "unknown_property";
+      } else if (strcmp(op, "set") == 0) {
+        if (!extractPayload(packet, len, "value", value, sizeof(value))) {
+          error = "invalid_value";
+        } else {
+          error = device.writeProperty(prop, value, strlen(value));
+        }
+      } else if (strcmp(op, "get") == 0) {
+        prop->snapshot(value);
+      } else {
+        error = "unknown_op";
+      }
+    }
+    if (error != nullptr) {
+      response.add("error", error);
+    } else {
+      response.add("id", id);
+      response.add("value", value);
+    }
+    reply(response, true);
+  }
+
+  // takes a free slot or else the one idle the longest
+  LanSession& openSession() {
+    unsigned long now = millis();
+    LanSession* session = &sessions[0];
+    for (LanSession& s : sessions) {
+      if (s.nonce[0] == '\0') {
+        session = &s;
+        break;
+      }
+      if (now - s.usedAt > now - session->usedAt) {
+        session = &s;
+      }
+    }
+    uint8_t n[4];
+    uint32_t r = random(0, 0x7fffffff) ^ micros();
+    memcpy(n, &r, sizeof(n));
+    formatHex(n, sizeof(n), session->nonce);
+    session->lastSeq = 0;
+    session->usedAt = now;
+    return *session;
+  }
+
+  LanSession* findSession(const char* nonce) {
+    for (LanSession& s : sessions) {
+      if (s.nonce[0] != '\0' && strcmp(s.nonce, nonce) == 0) {
+        return &s;
+      }
+    }
+    return nullptr;
+  }
+
+  // reason the request is refused, nullptr if it is signed and fresh
+  const char* authenticate(int len, const char* seq) {
+    const char* tag = ";mac=";
+    int macAt = -1;
+    for (int i = len - 5; i >= 0 && macAt < 0; i--) {
+      if (memcmp(packet + i, tag, 5) == 0) {
+        macAt = i;
+      }
+    }
+    char received[2 * LAN_MAC_SIZE + 1];
+    char expected[2 * LAN_MAC_SIZE + 1];
+    char requestNonce[sizeof(LanSession::nonce)];
+    if (macAt < 0 || len - macAt - 5 != 2 * LAN_MAC_SIZE) {
+      return "unauthorized";
+    }
+    memcpy(received, packet + macAt + 5, 2 * LAN_MAC_SIZE);
+    received[2 * LAN_MAC_SIZE] = '\0';
+    sign(secret, packet, macAt, expected);
+    if (!equalDigest(reinterpret_cast<const uint8_t*>(received), reinterpret_cast<const uint8_t*>(expected), 2 * LAN_MAC_SIZE)) {
+      return "unauthorized";
+    }
+    LanSession* session = nullptr;
+    if (!extractPayload(packet, macAt, "nonce", requestNonce, sizeof(requestNonce)) || (session = findSession(requestNonce)) == nullptr) {
+      return "stale_nonce";
+    }
+    uint32_t n = strtoul(seq, nullptr, 10);
+    if (n <= session->lastSeq) {
+      return "replayed";
+    }
+    session->lastSeq = n;
+    session->usedAt = millis();
+    return nullptr;
+  }
+
+  void sign(const uint8_t* key, const uint8_t* data, size_t len, char* out) {
+    uint8_t mac[SHA256_SIZE];
+    hmacSha256(key, SHA256_SIZE, data, len, mac);
+    formatHex(mac, LAN_MAC_SIZE, out);
+  }
+
+  void reply(SensoraPayload& response, bool authenticated) {
+    if (authenticated) {
+      char mac[2 * LAN_MAC_SIZE + 1];
+      sign(responseSecret, response.buffer(), response.length(), mac);
+      response.add("mac", mac);
+    }
+    udp.beginPacket(udp.remoteIP(), udp.remotePort());
+    udp.write(response.buffer(), response.length());
+    udp.endPacket();
+  }
+};
+
+#endif
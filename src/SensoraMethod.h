@@ -0,0 +1,82 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SensoraMethod_h
+#define SensoraMethod_h
+
+// request is the raw payload of the call, arguments are read from it with
+// extractPayload. Results are added to response, returning false reports
+// the call as failed.
+typedef bool (*MethodHandler)(const uint8_t* request, int length, SensoraPayload& response);
+
+// Command invoked over sc/<id>/rpc/req and answered right away on
+// sc/<id>/rpc/res, without waiting for a property to sync back. Handlers
+// run on the network side, in dual-core mode that is the sync task, so
+// they should be short and only touch properties through their setters.
+class Method {
+ public:
+  Method(const char* name, MethodHandler handler);
+
+  const char* name() const { return methodName; }
+
+  bool call(const uint8_t* request, int length, SensoraPayload& response) {
+    return handler(request, length, response);
+  }
+
+ private:
+  const char* methodName;
+  MethodHandler handler;
+};
+
+class MethodList {
+ public:
+  MethodList() : count(0) {}
+
+  void add(Method* method) {
+    if (count < DEVICE_MAX_METHODS) {
+      methods[count++] = method;
+    } else {
+      SENSORA_LOGE("Maximum methods reached. Please change DEVICE_MAX_METHODS");
+    }
+  }
+
+  Method* findByName(const char* name) {
+    for (int i = 0; i < count; i++) {
+      if (strcmp(methods[i]->name(), name) == 0) {
+        return methods[i];
+      }
+    }
+    return nullptr;
+  }
+
+  Method** begin() { return &methods[0]; }
+  Method** end() { return &methods[count]; }
+
+ private:
+  int count;
+  Method* methods[DEVICE_MAX_METHODS];
+};
+MethodList methodList;
+
+Method::Method(const char* name, MethodHandler handler) : methodName(name), handler(handler) {
+  if (methodList.findByName(name) != nullptr) {
+    SENSORA_LOGW("Method with name '%s' already exists", name);
+    return;
+  }
+  methodList.add(this);
+}
+
+#endif
@@ -0,0 +1,367 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SensoraOta_h
+#define SensoraOta_h
+
+// bytes read from the network and written to flash per sync step
+#ifndef SENSORA_OTA_CHUNK_SIZE
+#define SENSORA_OTA_CHUNK_SIZE 1024
+#endif
+
+#ifndef SENSORA_OTA_TIMEOUT_MS
+#define SENSORA_OTA_TIMEOUT_MS 10000
+#endif
+
+#ifndef SENSORA_OTA_RETRY_MS
+#define SENSORA_OTA_RETRY_MS 3000
+#endif
+
+// reconnects in a row without receiving any byte before giving up
+#ifndef SENSORA_OTA_MAX_RETRIES
+#define SENSORA_OTA_MAX_RETRIES 10
+#endif
+
+#define SENSORA_OTA_MAX_URL_LEN 128 + 1
+#define SENSORA_OTA_MAX_HOST_LEN 64 + 1
+
+// Destination of the firmware image, bytes arrive in order exactly once.
+class OtaWriter {
+ public:
+  virtual bool begin(size_t size) = 0;
+  virtual bool write(const uint8_t* data, size_t len) = 0;
+  // marks the new image bootable once every byte is written
+  virtual bool finish() = 0;
+  virtual void abort() = 0;
+  // boots into the new image
+  virtual void restart() = 0;
+};
+
+enum class OtaState : uint8_t {
+  Idle,
+  Connect,
+  Headers,
+  Body,
+  Restart
+};
+
+// Firmware update started by the "ota" method with
+// url=http://host[:port]/path;size=<bytes>;sha256=<hex>.
+//
+// The image is fetched over HTTP/1.1 and streamed chunk by chunk into the
+// writer while hashing it, nothing larger than one chunk is buffered. A
+// dropped connection is resumed with a Range request from the last byte
+// written. One chunk is handled per sync step so property sync keeps
+// running during the download. Progress is published on sc/<id>/ota/status
+// and the device restarts into the new image once the hash matches.
+//
+// https URLs need a client that speaks TLS, passed with tls set. A plain
+// client only takes http URLs and a TLS one only https.
+template <typename TClient, typename TDevice>
+class OtaUpdater {
+ public:
+  OtaUpdater(TClient& client, OtaWriter& writer, TDevice& device, bool tls = false)
+      : client(client), writer(writer), device(device), tls(tls), method("ota", handleCall), state(OtaState::Idle) {
+    instance = this;
+    device.attachService(step, this);
+  }
+
+  bool busy() const { return state != OtaState::Idle; }
+
+  // reason the update cannot start, nullptr once it is under way
+  const char* start(const char* imageUrl, size_t imageSize, const char* sha256) {
+    if (busy()) {
+      return "busy";
+    }
+    if (imageSize == 0 || !parseDigest(sha256) || !parseUrl(imageUrl)) {
+      return "invalid_argument";
+    }
+    if ((strncmp(imageUrl, "https://", 8) == 0) != tls) {
+      return "unsupported_scheme";
+    }
+    if (!writer.begin(imageSize)) {
+      return "begin_failed";
+    }
+    size = imageSize;
+    written = 0;
+    retries = 0;
+    reported = 0;
+    retryAt = millis();
+    sha.begin();
+    state = OtaState::Connect;
+    SENSORA_LOGI("starting firmware update from '%s', %u bytes", url, static_cast<unsigned>(size));
+    report("downloading", nullptr);
+    return nullptr;
+  }
+
+ private:
+  TClient& client;
+  OtaWriter& writer;
+  TDevice& device;
+  bool tls;
+  Method method;
+  OtaState state;
+  char url[SENSORA_OTA_MAX_URL_LEN];
+  char host[SENSORA_OTA_MAX_HOST_LEN];
+  const char* path;
+  uint16_t port;
+  uint8_t expected[SHA256_SIZE];
+  Sha256 sha;
+  size_t size;
+  size_t written;
+  size_t skip;
+  uint8_t retries;
+  uint8_t reported;
+  unsigned long retryAt;
+  unsigned long lastData;
+  int status;
+  char line[64];
+  size_t lineLen;
+  uint8_t chunk[SENSORA_OTA_CHUNK_SIZE];
+
+  static OtaUpdater* instance;
+
+  static bool handleCall(const uint8_t* request, int length, SensoraPayload& response) {
+    char imageUrl[SENSORA_OTA_MAX_URL_LEN];
+    char imageSize[12];
+    char sha256[2 * SHA256_SIZE + 1];
+    const char* error = "missing_argument";
+    if (extractPayload(request, length, "url", imageUrl, sizeof(imageUrl)) &&
+        extractPayload(request, length, "size", imageSize, sizeof(imageSize)) &&
+        extractPayload(request, length, "sha256", sha256, sizeof(sha256))) {
+      error = instance->start(imageUrl, strtoul(imageSize, nullptr, 10), sha256);
+    }
+    if (error != nullptr) {
+      response.add("reason", error);
+      return false;
+    }
+    response.add("state", "downloading");
+    return true;
+  }
+
+  static void step(void* arg) {
+    static_cast<OtaUpdater*>(arg)->poll();
+  }
+
+  void poll() {
+    switch (state) {
+      case OtaState::Connect:
+        if (static_cast<long>(millis() - retryAt) >= 0) {
+          connect();
+        }
+        break;
+      case OtaState::Headers:
+        readHeaders();
+        break;
+      case OtaState::Body:
+        readBody();
+        break;
+      case OtaState::Restart:
+        // leaves time for the final status to go out
+        if (millis() - retryAt >= SENSORA_OTA_RETRY_MS) {
+          writer.restart();
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  void connect() {
+    if (!client.connect(host, port)) {
+      retry("connect_failed");
+      return;
+    }
+    char request[SENSORA_OTA_MAX_URL_LEN + SENSORA_OTA_MAX_HOST_LEN + 96];
+    int len = snprintf(request, sizeof(request),
+                       "GET %s HTTP/1.1\r\nHost: %s\r\nRange: bytes=%u-\r\nConnection: close\r\n\r\n",
+                       path, host, static_cast<unsigned>(written));
+    client.write(reinterpret_cast<const uint8_t*>(request), len);
+    status = 0;
+    lineLen = 0;
+    lastData = millis();
+    state = OtaState::Headers;
+  }
+
+  void readHeaders() {
+    while (client.available() > 0) {
+      int c = client.read();
+      lastData = millis();
+      if (c != '\n') {
+        if (c != '\r' && lineLen < sizeof(line) - 1) {
+          line[lineLen++] = c;
+        }
+        continue;
+      }
+      line[lineLen] = '\0';
+      if (status == 0) {
+        // HTTP/1.1 206 Partial Content
+        const char* code = strchr(line, ' ');
+        status = code == nullptr ? -1 : parseInt(code + 1);
+      } else if (lineLen == 0) {
+        startBody();
+        return;
+      }
+      lineLen = 0;
+    }
+    checkStalled();
+  }
+
+  void startBody() {
+    if (status == 206) {
+      skip = 0;
+    } else if (status == 200) {
+      // server ignored the range, drop what is already written
+      skip = written;
+    } else if (status >= 500) {
+      retry("server_error");
+      return;
+    } else {
+      fail("http_error");
+      return;
+    }
+    state = OtaState::Body;
+  }
+
+  void readBody() {
+    int available = client.available();
+    if (available <= 0) {
+      checkStalled();
+      return;
+    }
+    size_t want = size - written + skip;
+    size_t n = available < SENSORA_OTA_CHUNK_SIZE ? available : SENSORA_OTA_CHUNK_SIZE;
+    n = n < want ? n : want;
+    int got = client.read(chunk, n);
+    if (got <= 0) {
+      return;
+    }
+    lastData = millis();
+    size_t offset = skip < static_cast<size_t>(got) ? skip : got;
+    skip -= offset;
+    if (static_cast<size_t>(got) > offset) {
+      if (!writer.write(chunk + offset, got - offset)) {
+        fail("write_failed");
+        return;
+      }
+      sha.update(chunk + offset, got - offset);
+      written += got - offset;
+      retries = 0;
+    }
+    if (written == size) {
+      complete();
+      return;
+    }
+    uint8_t progress = static_cast<uint64_t>(written) * 100 / size;
+    if (progress >= reported + 10) {
+      reported = progress - progress % 10;
+      report("downloading", nullptr);
+    }
+  }
+
+  void complete() {
+    client.stop();
+    uint8_t digest[SHA256_SIZE];
+    sha.finish(digest);
+    if (!equalDigest(digest, expected, SHA256_SIZE)) {
+      fail("hash_mismatch");
+      return;
+    }
+    if (!writer.finish()) {
+      fail("finish_failed");
+      return;
+    }
+    SENSORA_LOGI("firmware update verified, restarting");
+    reported = 100;
+    report("done", nullptr);
+    retryAt = millis();
+    state = OtaState::Restart;
+  }
+
+  void checkStalled() {
+    if (!client.connected()) {
+      retry("disconnected");
+    } else if (millis() - lastData >= SENSORA_OTA_TIMEOUT_MS) {
+      retry("timeout");
+    }
+  }
+
+  void retry(const char* reason) {
+    client.stop();
+    if (++retries > SENSORA_OTA_MAX_RETRIES) {
+      fail(reason);
+      return;
+    }
+    SENSORA_LOGW("firmware download interrupted (%s) at %u bytes, resuming", reason, static_cast<unsigned>(written));
+    retryAt = millis() + SENSORA_OTA_RETRY_MS;
+    state = OtaState::Connect;
+  }
+
+  void fail(const char* reason) {
+    SENSORA_LOGE("firmware update failed: %s", reason);
+    client.stop();
+    writer.abort();
+    state = OtaState::Idle;
+    report("failed", reason);
+  }
+
+  void report(const char* s, const char* error) {
+    SensoraPayload payload;
+    payload.add("state", s);
+    payload.add("progress", reported);
+    if (error != nullptr) {
+      payload.add("error", error);
+    }
+    device.publish("ota/status", payload);
+  }
+
+  bool parseDigest(const char* hex) {
+    return parseHex(hex, expected, SHA256_SIZE);
+  }
+
+  bool parseUrl(const char* u) {
+    if (strlen(u) >= sizeof(url)) {
+      return false;
+    }
+    strcpy(url, u);
+    const char* p = url;
+    port = 80;
+    if (strncmp(p, "http://", 7) == 0) {
+      p += 7;
+    } else if (strncmp(p, "https://", 8) == 0) {
+      p += 8;
+      port = 443;
+    }
+    size_t hostLen = strcspn(p, ":/");
+    if (hostLen == 0 || hostLen >= sizeof(host)) {
+      return false;
+    }
+    memcpy(host, p, hostLen);
+    host[hostLen] = '\0';
+    p += hostLen;
+    if (*p == ':') {
+      port = parseInt(p + 1);
+      p = strchr(p, '/');
+    }
+    path = p != nullptr && *p == '/' ? p : "/";
+    return port != 0;
+  }
+};
+
+template <typename TClient, typename TDevice>
+OtaUpdater<TClient, TDevice>* OtaUpdater<TClient, TDevice>::instance = nullptr;
+
+#endif
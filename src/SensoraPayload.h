@@ -17,36 +17,39 @@
 #ifndef SensoraPayload_h
 #define SensoraPayload_h
 
-#include <WString.h>
-#define SENSORA_PAYLOAD_SIZE 128
+#ifndef SENSORA_PAYLOAD_SIZE
+#define SENSORA_PAYLOAD_SIZE 192
+#endif
 
 class SensoraPayload {
  public:
   SensoraPayload() : bufLen(0) {}
 
-  bool add(const char* key, const String& value) {
-    return addSafe(key, value.c_str());
-  }
-
   bool add(const char* key, const char* value) {
     return addSafe(key, value);
   }
 
   bool add(const char* key, int8_t value) {
-    char buffer[5];
-    snprintf(buffer, sizeof(buffer), "%d", value);
+    char buffer[12];
+    formatInt(value, buffer);
     return addSafe(key, buffer);
   }
 
   bool add(const char* key, uint8_t value) {
-    char buffer[4];
-    snprintf(buffer, sizeof(buffer), "%u", value);
+    char buffer[12];
+    formatUInt(value, buffer);
     return addSafe(key, buffer);
   }
 
   bool add(const char* key, uint32_t value) {
-    char buffer[11];
-    ultoa(value, buffer, 10);
+    char buffer[12];
+    formatUInt(value, buffer);
+    return addSafe(key, buffer);
+  }
+
+  bool add(const char* key, float value) {
+    char buffer[16];
+    formatFloat(value, buffer);
     return addSafe(key, buffer);
   }
 
@@ -54,6 +57,20 @@ class SensoraPayload {
     return bufLen;
   }
 
+  // longest escaped value that still fits under key
+  size_t room(const char* key) const {
+    size_t used = bufLen + strlen(key) + 3;
+    return used < SENSORA_PAYLOAD_SIZE ? SENSORA_PAYLOAD_SIZE - used : 0;
+  }
+
+  static size_t escapedLength(const char* s) {
+    size_t len = 0;
+    for (; *s; s++) {
+      len += *s == ';' ? 2 : 1;
+    }
+    return len;
+  }
+
   uint8_t* buffer() {
     payload[bufLen] = '\0';
     return payload;
@@ -70,13 +87,12 @@ class SensoraPayload {
 
   bool addSafe(const char* key, const char* value) {
     size_t keyLen = strlen(key);
-    size_t valueLen = strlen(value);
     if (keyLen == 0) {
       return false;
     }
 
-    // totalLen = key + '=' + value + ';'
-    size_t totalLen = keyLen + 1 + valueLen + 1;
+    // totalLen = key + '=' + escaped value + ';'
+    size_t totalLen = keyLen + 1 + escapedLength(value) + 1;
     if (bufLen + totalLen >= SENSORA_PAYLOAD_SIZE) {
       SENSORA_LOGW("failed to add key '%s', not enough space in payload", key);
       return false;
@@ -86,7 +102,7 @@ class SensoraPayload {
     }
     add(key);
     add("=");
-    add(escape(value).c_str());
+    escape(value);
     return true;
   }
 
@@ -106,17 +122,14 @@ class SensoraPayload {
     bufLen += len;
   }
 
-  String escape(const char* s) {
-    String result;
-    while (*s) {
+  // copies s into the payload with ';' escaped, space is checked by addSafe
+  void escape(const char* s) {
+    for (; *s; s++) {
       if (*s == ';') {
-        result += "\\;";
-      } else {
-        result += *s;
+        payload[bufLen++] = '\\';
       }
-      s++;
+      payload[bufLen++] = *s;
     }
-    return result;
   }
 };
 
@@ -37,28 +37,59 @@ enum class SyncStrategy {
   OnChange
 };
 
+// order in which pending updates go out, Critical ones are published on
+// the next loop() whatever else is due
+enum class Priority : uint8_t {
+  Low,
+  Normal,
+  High,
+  Critical
+};
+
+struct PropertyRecord {
+  uint8_t len;
+  char value[PROPERTY_BUFFER_SIZE];
+};
+
+class Property;
+
+struct PropertyWrite {
+  Property* prop;
+  size_t len;
+  // writes left in the batch including this one, 0 for a single write
+  uint8_t batch;
+  char value[PROPERTY_BUFFER_SIZE];
+};
+
+#define PROPERTY_SNAPSHOT_SPINS 16
+
+// Writers never block: a setValue() that overlaps another write to the same
+// value, e.g. from an interrupt, parks its value and the write in progress
+// applies it when it finishes. Readers on other tasks take a copy with
+// snapshot() and retry if a write happened meanwhile.
 class PropertyValue {
  public:
-  PropertyValue() : len(0) {
+  PropertyValue() : len(0), seq(0), parked(Parked::Empty), parkedLen(0) {
     buff[0] = '\0';
   }
 
   void setValue(int val) {
-    len = snprintf(buff, PROPERTY_BUFFER_SIZE, "%i", val);
+    char v[PROPERTY_BUFFER_SIZE];
+    set(v, formatInt(val, v));
   }
 
   void setValue(float val) {
-    len = snprintf(buff, PROPERTY_BUFFER_SIZE, "%.3f", val);
+    char v[PROPERTY_BUFFER_SIZE];
+    set(v, formatFixed(val, 3, v, PROPERTY_BUFFER_SIZE));
   }
 
   void setValue(double val) {
-    len = snprintf(buff, PROPERTY_BUFFER_SIZE, "%.8f", val);
+    char v[PROPERTY_BUFFER_SIZE];
+    set(v, formatFixed(val, 8, v, PROPERTY_BUFFER_SIZE));
   }
 
   void setValue(const char* s) {
-    strncpy(buff, s, PROPERTY_BUFFER_SIZE - 1);
-    buff[PROPERTY_BUFFER_SIZE - 1] = '\0';
-    len = strlen(buff);
+    set(s, strlen(s));
   }
 
   void setValue(bool b) {
@@ -69,38 +100,175 @@ class PropertyValue {
     }
   }
 
+  void setValue(const RgbColor& c) {
+    char v[8];
+    formatColor(c, v);
+    setValue(v);
+  }
+
+  void setValue(const HsvColor& c) {
+    setValue(hsvToRgb(c));
+  }
+
+  void setValue(const GeoLocation& l) {
+    char v[24];
+    formatLocation(l, v);
+    setValue(v);
+  }
+
   int Int() {
-    return atoi(buff);
+    char v[PROPERTY_BUFFER_SIZE];
+    snapshot(v);
+    return parseInt(v);
   }
 
   bool Bool() {
-    return strncmp(buff, "true", 4) == 0;
+    char v[PROPERTY_BUFFER_SIZE];
+    snapshot(v);
+    return strncmp(v, "true", 4) == 0;
+  }
+
+  float Float() {
+    char v[PROPERTY_BUFFER_SIZE];
+    snapshot(v);
+    return parseFloat(v);
+  }
+
+  RgbColor Color() {
+    char v[PROPERTY_BUFFER_SIZE];
+    snapshot(v);
+    RgbColor c = {0, 0, 0};
+    parseColor(v, c);
+    return c;
+  }
+
+  HsvColor Hsv() {
+    return rgbToHsv(Color());
+  }
+
+  GeoLocation Location() {
+    char v[PROPERTY_BUFFER_SIZE];
+    snapshot(v);
+    GeoLocation l = {0, 0};
+    parseLocation(v, l);
+    return l;
   }
 
+  // only safe on the task that writes the value, use snapshot() elsewhere
   const char* getBuff() { return buff; }
   const size_t getLen() { return len; }
 
+  // copies a consistent value into out, which must hold PROPERTY_BUFFER_SIZE
+  // bytes. Must not be called from an interrupt. After a few failed tries it
+  // sleeps between attempts so a writer preempted on this core can finish.
+  size_t snapshot(char* out) const {
+    for (unsigned attempt = 0;; attempt++) {
+      if (attempt >= PROPERTY_SNAPSHOT_SPINS) {
+        delay(1);
+      }
+      uint32_t s = seq.load(std::memory_order_acquire);
+      if (s & 1) {
+        continue;
+      }
+      size_t n = len < PROPERTY_BUFFER_SIZE ? len : PROPERTY_BUFFER_SIZE - 1;
+      memcpy(out, buff, n);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq.load(std::memory_order_relaxed) == s) {
+        out[n] = '\0';
+        return n;
+      }
+    }
+  }
+
  protected:
   void updateBuffer(const char* msg, int length) {
-    int cLen = length > PROPERTY_BUFFER_SIZE - 1 ? PROPERTY_BUFFER_SIZE - 1 : length;
-    memcpy(buff, msg, cLen);
-    buff[cLen] = '\0';
-    len = cLen;
+    store(msg, length < 0 ? 0 : length);
   }
 
   PropertyValue& value() {
     return *this;
   }
 
+  // runs after every setValue(), not for values received from the cloud
+  virtual void onSet() {}
+
+  // a write between these two, e.g. from an interrupt, is applied when
+  // endWrite() runs
+  bool beginWrite() {
+    uint32_t s = seq.load();
+    return (s & 1) == 0 && seq.compare_exchange_strong(s, s + 1);
+  }
+
+  // publishes the write and applies a value parked meanwhile
+  void endWrite() {
+    seq.store(seq.load(std::memory_order_relaxed) + 1);
+    while (parked.load() == Parked::Ready && beginWrite()) {
+      uint8_t p = Parked::Ready;
+      if (parked.compare_exchange_strong(p, Parked::Filling)) {
+        memcpy(buff, parkedValue, parkedLen + 1);
+        len = parkedLen;
+        parked.store(Parked::Empty);
+      }
+      seq.store(seq.load(std::memory_order_relaxed) + 1);
+    }
+  }
+
  private:
+  enum Parked : uint8_t {
+    Empty,
+    Filling,
+    Ready
+  };
+
   char buff[PROPERTY_BUFFER_SIZE];
   size_t len;
+  // odd while a write is in progress
+  std::atomic<uint32_t> seq;
+  // value of a write that overlapped the one in progress
+  std::atomic<uint8_t> parked;
+  char parkedValue[PROPERTY_BUFFER_SIZE];
+  size_t parkedLen;
+
+  void set(const char* v, size_t n) {
+    store(v, n);
+    onSet();
+  }
+
+  void store(const char* v, size_t n) {
+    if (n > PROPERTY_BUFFER_SIZE - 1) {
+      n = PROPERTY_BUFFER_SIZE - 1;
+    }
+    if (beginWrite()) {
+      memcpy(buff, v, n);
+      buff[n] = '\0';
+      len = n;
+      endWrite();
+      return;
+    }
+    // a newer parked value replaces an older one that was not applied yet,
+    // only a third overlapping writer is dropped
+    uint8_t p = Parked::Empty;
+    if (!parked.compare_exchange_strong(p, Parked::Filling)) {
+      p = Parked::Ready;
+      if (!parked.compare_exchange_strong(p, Parked::Filling)) {
+        return;
+      }
+    }
+    memcpy(parkedValue, v, n);
+    parkedValue[n] = '\0';
+    parkedLen = n;
+    parked.store(Parked::Ready);
+    // the other writer may have finished before the value was parked
+    if (beginWrite()) {
+      endWrite();
+    }
+  }
 };
 
 class Property : public PropertyValue {
  public:
   typedef void (*PropertySubscribeCb)(PropertyValue&);
-  Property() {}
+  Property() : priority(Priority::Normal), urgent(false) {}
   Property(const char* id, const char* nodeId);
   const char* ID() { return id; }
   const char* nodeId() { return node; }
@@ -108,6 +276,7 @@ class Property : public PropertyValue {
   DataType getDataType() const { return dataType; }
   AccessMode getAccessMode() const { return accessMode; }
   SyncStrategy getSyncStrategy() { return syncStrategy; }
+  Aggregation getAggregation() const { return window.getOp(); }
 
   Property& setAccessMode(AccessMode m) {
     accessMode = m;
@@ -129,6 +298,12 @@ class Property : public PropertyValue {
       case DataType::Boolean:
         this->setValue(false);
         break;
+      case DataType::Color:
+        this->setValue(RgbColor{0, 0, 0});
+        break;
+      case DataType::Location:
+        this->setValue(GeoLocation{0, 0});
+        break;
       default:
         break;
     }
@@ -140,38 +315,226 @@ class Property : public PropertyValue {
     return *this;
   }
 
+  // value is written to flash once it stops changing and restored on boot
+  Property& setPersistent(bool p = true) {
+    persistent = p;
+    return *this;
+  }
+
+  bool isPersistent() const { return persistent; }
+
+  // identifies the property in storage and RTC memory whatever its place
+  // in the list
+  uint32_t idCrc() const {
+    return computeCrc32(reinterpret_cast<const uint8_t*>(id), strlen(id));
+  }
+
+  void persistKey(char* key, size_t len) {
+    snprintf(key, len, "p%08lx", static_cast<unsigned long>(idCrc()));
+  }
+
+  // true once the value has been stable for PROPERTY_PERSIST_DELAY_MS
+  bool shouldPersist(const char* value, size_t len) {
+    uint32_t crc = computeCrc32(reinterpret_cast<const uint8_t*>(value), len);
+    if (crc == persistedCrc) {
+      return false;
+    }
+    if (crc != pendingCrc) {
+      pendingCrc = crc;
+      persistChangedAt = millis();
+      return false;
+    }
+    return millis() - persistChangedAt >= PROPERTY_PERSIST_DELAY_MS;
+  }
+
+  void onPersisted() {
+    persistedCrc = pendingCrc;
+  }
+
+  void restore(const PropertyRecord& record) {
+    updateBuffer(record.value, record.len);
+    persistedCrc = pendingCrc = computeCrc32(reinterpret_cast<const uint8_t*>(getBuff()), getLen());
+    notify();
+  }
+
+  // High properties are walked before Normal and Low ones, Critical ones
+  // skip the sync interval and sample window and are published on the next
+  // loop(), ahead of stats and the per-loop budget
+  Property& setPriority(Priority p);
+  Priority getPriority() const { return priority; }
+
+  // true once after a setValue() on a Critical property
+  bool takeUrgent() { return urgent.exchange(false); }
+
   Property& setSyncStrategy(SyncStrategy strategy, unsigned long interval = 15000) {
     syncStrategy = strategy;
     syncIntervalMs = interval;
     return *this;
   }
 
-  bool shouldSync() {
+  // publishes at most perSecond values on average with bursts of burst,
+  // changes in between are held back and the newest one is sent once a
+  // token is available
+  Property& setRateLimit(float perSecond, uint8_t burst = 1) {
+    rate.begin(perSecond, burst);
+    return *this;
+  }
+
+  bool rateAvailable() { return rate.available(); }
+  void takeRateToken() { rate.take(); }
+
+  // value was due but held back by a rate limit, counted once per value
+  void onRateLimited(const char* value, size_t len) {
+    uint32_t crc = computeCrc32(reinterpret_cast<const uint8_t*>(value), len);
+    if (crc != suppressedCrc) {
+      suppressedCrc = crc;
+      suppressed++;
+    }
+  }
+
+  uint32_t rateSuppressed() const { return suppressed; }
+
+  // a Location is only published again once it moved further than meters
+  Property& setDeadband(float meters) {
+    deadband = meters;
+    return *this;
+  }
+
+  // raw samples pushed with pushSample() are kept in storage until the next
+  // publish is due, the newest one becomes the property value unless an
+  // aggregation is set
+  Property& setSampleBuffer(float* storage, size_t size) {
+    samples.begin(storage, size);
+    return *this;
+  }
+
+  // publishes the aggregate of the samples pushed during each sync window
+  // instead of the newest one, param is the smoothing factor for Ema and the
+  // quantile (0..1) for Percentile
+  Property& setAggregation(Aggregation op, float param = 0) {
+    window.begin(op, param);
+    return *this;
+  }
+
+  // lock-free, safe to call from an interrupt
+  bool pushSample(float v) { return samples.push(v); }
+
+  uint32_t sampleDrops() const { return samples.drops(); }
+
+  // records the value every pointIntervalMs into storage and uploads the
+  // compressed batch once windowMs has passed or storage is full, only for
+  // Integer and Float properties
+  Property& setHistory(uint8_t* storage, size_t size, unsigned long pointIntervalMs, unsigned long windowMs) {
+    history.begin(storage, size, id);
+    historyIntervalMs = pointIntervalMs;
+    historyWindowMs = windowMs;
+    return *this;
+  }
+
+  // value is a snapshot() of this property, true when a batch is ready
+  bool recordHistory(const char* value) {
+    if (!history.active() || (dataType != DataType::Integer && dataType != DataType::Float)) {
+      return false;
+    }
+    unsigned long now = millis();
+    bool full = false;
+    if (history.count() == 0 || now - historyPointAt >= historyIntervalMs) {
+      if (history.add(now, parseFloat(value))) {
+        historyPointAt = now;
+      } else {
+        full = true;
+      }
+    }
+    return history.count() > 0 && (full || now - history.firstTime() >= historyWindowMs);
+  }
+
+  const uint8_t* historyBatch(size_t& len) {
+    len = history.seal(millis());
+    return history.data();
+  }
+
+  void onHistorySent() { history.reset(); }
+
+  void drainSamples() {
+    if (!samples.active()) {
+      return;
+    }
+    // periodic windows are timed on their own, a publish that is skipped
+    // or fails must not stretch the next window
+    unsigned long now = millis();
+    bool due = syncStrategy != SyncStrategy::Periodic || priority == Priority::Critical || windowStartedAt == 0 ||
+               now - windowStartedAt >= syncIntervalMs;
+    float v;
+    if (window.getOp() != Aggregation::None) {
+      // aggregate on every pass so the ring only has to cover one loop
+      while (samples.pop(v)) {
+        window.add(v);
+      }
+      if (due && window.count() > 0) {
+        if (window.getOp() == Aggregation::Count) {
+          setValue(static_cast<int>(window.count()));
+        } else {
+          setValue(window.result());
+        }
+        window.reset();
+        windowStartedAt = now;
+      }
+      return;
+    }
+    // drain on every pass too, a full ring would drop the newest samples
+    while (samples.pop(v)) {
+      latestSample = v;
+      sampled = true;
+    }
+    if (due && sampled) {
+      setValue(latestSample);
+      sampled = false;
+      windowStartedAt = now;
+    }
+  }
+
+  // a queued cloud write will overwrite the local value, do not publish it.
+  // The inbox counts a write after queueing it, so the consumer may pop it
+  // first and see -1 for a moment
+  void onInboxPushed() { inboxPending++; }
+  int8_t onInboxPopped() { return --inboxPending; }
+
+  // value is a snapshot() of this property
+  bool shouldSync(const char* value) {
+    if (inboxPending > 0) {
+      return false;
+    }
     if (cloudSyncedAt == 0) {
       return true;
     }
 
-    if (syncStrategy == SyncStrategy::OnChange) {
-      return (strcmp(getBuff(), cloudValue) != 0);
+    if (syncStrategy == SyncStrategy::OnChange || priority == Priority::Critical) {
+      return changed(value);
     }
     unsigned long now = millis();
     if (syncStrategy == SyncStrategy::Periodic) {
-      return now - cloudSyncedAt >= syncIntervalMs && strcmp(getBuff(), cloudValue) != 0;
+      return now - cloudSyncedAt >= syncIntervalMs && changed(value);
     }
     return false;
   }
 
-  void onCloudSynced() {
-    size_t len = getLen();
-    if (len >= PROPERTY_BUFFER_SIZE) {
-      len = PROPERTY_BUFFER_SIZE - 1;
-    }
-    memcpy(cloudValue, getBuff(), len);
+  // value received from the cloud or published to it, runs on the sync side
+  void onCloudSynced(const char* value, size_t length) {
+    size_t len = length >= PROPERTY_BUFFER_SIZE ? PROPERTY_BUFFER_SIZE - 1 : length;
+    memcpy(cloudValue, value, len);
     cloudValue[len] = '\0';
     cloudSyncedAt = millis();
     cloudSyncFails = 0;
   }
 
+  const char* getCloudValue() const { return cloudValue; }
+  unsigned long getCloudSyncedAt() const { return cloudSyncedAt; }
+
+  void restoreCloudState(const char* value, unsigned long syncedAt) {
+    copyString(value, cloudValue);
+    cloudSyncedAt = syncedAt;
+  }
+
   void onCloudSyncFailed() {
     // max 30 * 500ms = 15 seconds
     if (cloudSyncFails == 30) {
@@ -183,29 +546,89 @@ class Property : public PropertyValue {
 
   void onMessage(const char* msg, size_t length) {
     updateBuffer(msg, length);
-    onCloudSynced();
+    notify();
+  }
+
+  // stores an inbound value without running the callback
+  void apply(const char* msg, size_t length) {
+    updateBuffer(msg, length);
+  }
+
+  // checks an inbound value before it is queued for the application
+  virtual bool accepts(const char* value) {
+    if (dataType == DataType::Color) {
+      RgbColor c;
+      return parseColor(value, c);
+    }
+    if (dataType == DataType::Location) {
+      GeoLocation l;
+      return parseLocation(value, l);
+    }
+    return true;
+  }
+
+  // adds type specific metadata to prop/info
+  virtual void describe(SensoraPayload& payload) {}
+
+  // runs the subscribe callback with the current value
+  virtual void notify() {
     if (cb != nullptr) {
       cb(value());
     }
   }
 
+ protected:
+  void onSet();
+
  private:
+  bool changed(const char* value) {
+    if (dataType == DataType::Location && deadband > 0) {
+      GeoLocation a, b;
+      if (parseLocation(value, a) && parseLocation(cloudValue, b)) {
+        return distanceMeters(a, b) > deadband;
+      }
+    }
+    return strcmp(value, cloudValue) != 0;
+  }
+
   const char* id;
   const char* node;
   DataType dataType;
   AccessMode accessMode;
   SyncStrategy syncStrategy;
+  Priority priority;
+  std::atomic<bool> urgent;
   PropertySubscribeCb cb;
+  SampleRing samples;
+  AggregateWindow window;
+  unsigned long windowStartedAt;
+  float latestSample;
+  bool sampled;
+  HistoryEncoder history;
+  unsigned long historyIntervalMs;
+  unsigned long historyWindowMs;
+  unsigned long historyPointAt;
+
+  TokenBucket rate;
+  uint32_t suppressed;
+  uint32_t suppressedCrc;
+
+  std::atomic<int8_t> inboxPending;
+  bool persistent;
+  uint32_t persistedCrc;
+  uint32_t pendingCrc;
+  unsigned long persistChangedAt;
 
   int cloudSyncFails;
   unsigned long cloudSyncedAt;
   unsigned long syncIntervalMs;
+  float deadband;
   char cloudValue[PROPERTY_BUFFER_SIZE];
 };
 
 class PropertyList {
  public:
-  PropertyList() : _propertyCount(0) {}
+  PropertyList() : urgentPending(false), _propertyCount(0) {}
 
   void add(Property* prop) {
     if (_propertyCount < DEVICE_MAX_PROPERTIES) {
@@ -233,7 +656,31 @@ class PropertyList {
   Property** begin() { return &_properties[0]; }
   Property** end() { return &_properties[_propertyCount]; }
 
+  // keeps the list ordered by priority, properties of the same priority
+  // stay in declaration order
+  void reorder(Property* prop) {
+    int i = 0;
+    while (i < _propertyCount && _properties[i] != prop) {
+      i++;
+    }
+    if (i == _propertyCount) {
+      return;
+    }
+    for (; i > 0 && _properties[i - 1]->getPriority() < prop->getPriority(); i--) {
+      _properties[i] = _properties[i - 1];
+    }
+    for (; i < _propertyCount - 1 && _properties[i + 1]->getPriority() > prop->getPriority(); i++) {
+      _properties[i] = _properties[i + 1];
+    }
+    _properties[i] = prop;
+  }
+
+  // set from any task when a Critical property changes
+  void markUrgent() { urgentPending.store(true, std::memory_order_release); }
+  bool takeUrgent() { return urgentPending.exchange(false, std::memory_order_acquire); }
+
  private:
+  std::atomic<bool> urgentPending;
   int _propertyCount;
   const char* error;
   Property* _properties[DEVICE_MAX_PROPERTIES];
@@ -241,7 +688,7 @@ class PropertyList {
 PropertyList propertyList;
 
 Property::Property(const char* id, const char* nodeId = "")
-    : id(id), node(nodeId), accessMode(AccessMode::Read), dataType(DataType::String), syncStrategy(SyncStrategy::OnChange) {
+    : id(id), node(nodeId), dataType(DataType::String), accessMode(AccessMode::Read), syncStrategy(SyncStrategy::OnChange), priority(Priority::Normal), urgent(false), windowStartedAt(0), latestSample(0), sampled(false), suppressed(0), suppressedCrc(0), inboxPending(0), persistent(false), deadband(0) {
   if (propertyList.findById("id") != nullptr) {
     SENSORA_LOGW("Property with id '%s' already exists");
     return;
@@ -250,4 +697,101 @@ Property::Property(const char* id, const char* nodeId = "")
   propertyList.add(this);
 }
 
+Property& Property::setPriority(Priority p) {
+  priority = p;
+  propertyList.reorder(this);
+  return *this;
+}
+
+void Property::onSet() {
+  if (priority == Priority::Critical) {
+    urgent.store(true, std::memory_order_release);
+    propertyList.markUrgent();
+  }
+}
+
+// Property holding an index into a fixed label table, for example
+//
+//   const char* const modes[] = {"off", "eco", "boost"};
+//   EnumProperty<3> modeProperty("mode", modes);
+//
+// The index is sent and received, the labels go out once with prop/info and
+// must not contain ','.
+template <uint8_t N>
+class EnumProperty : public Property {
+ public:
+  typedef void (*EnumSubscribeCb)(uint8_t);
+
+  EnumProperty(const char* id, const char* const (&labels)[N], const char* nodeId = "")
+      : Property(id, nodeId), labels(labels), enumCb(nullptr) {
+    setDataType(DataType::Enum);
+    setValue(0);
+  }
+
+  EnumProperty& set(uint8_t i) {
+    if (i < N) {
+      setValue(static_cast<int>(i));
+    }
+    return *this;
+  }
+
+  uint8_t index() {
+    int i = Int();
+    return i >= 0 && i < N ? i : 0;
+  }
+
+  const char* label() { return labels[index()]; }
+
+  EnumProperty& subscribe(EnumSubscribeCb callback) {
+    enumCb = callback;
+    return *this;
+  }
+
+  bool accepts(const char* value) {
+    size_t len = strlen(value);
+    if (len == 0 || len > 3) {
+      return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+      if (static_cast<uint8_t>(value[i] - '0') >= 10) {
+        return false;
+      }
+    }
+    return parseInt(value) < N;
+  }
+
+  void notify() {
+    if (enumCb != nullptr) {
+      enumCb(index());
+    }
+  }
+
+  void describe(SensoraPayload& payload) {
+    char table[PROPERTY_BUFFER_SIZE * 2];
+    size_t room = payload.room("labels");
+    size_t len = 0;
+    size_t escaped = 0;
+    for (uint8_t i = 0; i < N; i++) {
+      size_t l = strlen(labels[i]);
+      size_t e = SensoraPayload::escapedLength(labels[i]) + (i > 0 ? 1 : 0);
+      if (len + l + 2 > sizeof(table) || escaped + e > room) {
+        SENSORA_LOGW("labels of enum property '%s' are too long", ID());
+        break;
+      }
+      if (i > 0) {
+        table[len++] = ',';
+      }
+      memcpy(table + len, labels[i], l);
+      len += l;
+      escaped += e;
+    }
+    table[len] = '\0';
+    payload.add("labels", table);
+  }
+
+ private:
+  const char* const (&labels)[N];
+  EnumSubscribeCb enumCb;
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SensoraQueue_h
+#define SensoraQueue_h
+
+#include <atomic>
+
+// Lock-free ring for exactly one producer and one consumer, which may run on
+// different cores. N must be a power of two.
+template <typename T, size_t N>
+class SpscQueue {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+ public:
+  SpscQueue() : head(0), tail(0) {}
+
+  bool push(const T& item) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) >= N) {
+      return false;
+    }
+    items[t & (N - 1)] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& item) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items[h & (N - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+  }
+
+  // i-th queued item, only valid when producer and consumer share a thread
+  T& at(size_t i) {
+    return items[(head.load(std::memory_order_relaxed) + i) & (N - 1)];
+  }
+
+  size_t space() const { return N - size(); }
+
+  // producer side: i-th free slot, the first n slots become visible to the
+  // consumer at once with commit(n)
+  T& slot(size_t i) {
+    return items[(tail.load(std::memory_order_relaxed) + i) & (N - 1)];
+  }
+
+  void commit(size_t n) {
+    tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+  }
+
+ private:
+  T items[N];
+  std::atomic<size_t> head;
+  std::atomic<size_t> tail;
+};
+
+// Ring of raw samples over caller-owned storage for one producer, typically
+// an interrupt, and one consumer. The capacity is size rounded down to a
+// power of two.
+class SampleRing {
+ public:
+  SampleRing() : items(nullptr), mask(0), head(0), tail(0), dropCount(0) {}
+
+  void begin(float* storage, size_t size) {
+    size_t n = 1;
+    while (n * 2 <= size) {
+      n *= 2;
+    }
+    items = size > 0 ? storage : nullptr;
+    mask = n - 1;
+    head = tail = 0;
+  }
+
+  bool push(float v) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (items == nullptr || t - head.load(std::memory_order_acquire) > mask) {
+      dropCount.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    items[t & mask] = v;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(float& v) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    v = items[h & mask];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool active() const { return items != nullptr; }
+  uint32_t drops() const { return dropCount.load(std::memory_order_relaxed); }
+
+ private:
+  float* items;
+  size_t mask;
+  std::atomic<size_t> head;
+  std::atomic<size_t> tail;
+  std::atomic<uint32_t> dropCount;
+};
+
+#endif
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SensoraRate_h
+#define SensoraRate_h
+
+// Token bucket holding up to burst tokens, refilled at perSecond tokens per
+// second. An inactive bucket never limits.
+class TokenBucket {
+ public:
+  TokenBucket() : rate(0), burst(0), tokens(0), refilledAt(0) {}
+
+  void begin(float perSecond, float size) {
+    rate = perSecond;
+    burst = size < 1 ? 1 : size;
+    tokens = burst;
+    refilledAt = millis();
+  }
+
+  bool active() const { return rate > 0; }
+
+  bool available() {
+    if (!active()) {
+      return true;
+    }
+    unsigned long now = millis();
+    tokens += (now - refilledAt) * rate / 1000;
+    if (tokens > burst) {
+      tokens = burst;
+    }
+    refilledAt = now;
+    return tokens >= 1;
+  }
+
+  // call after available() returned true
+  void take() {
+    if (active()) {
+      tokens -= 1;
+    }
+  }
+
+ private:
+  float rate;
+  float burst;
+  float tokens;
+  unsigned long refilledAt;
+};
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SensoraRouter_h
+#define SensoraRouter_h
+
+enum class RouteKind : uint8_t {
+  None,
+  // payload carries id=<property>;value=<value>
+  Payload,
+  // topic names the property, payload is the raw value
+  Property,
+  // payload carries batch=<id>;<property>=<value>;...
+  Batch,
+  // payload carries cid=<id>;method=<name> and the arguments
+  Call
+};
+
+// one topic level, children are kept as a linked list of siblings
+struct RouteNode {
+  const char* level;
+  uint8_t len;
+  int16_t child;
+  int16_t sibling;
+  RouteKind kind;
+  Property* prop;
+};
+
+// Trie of the exact topics the device handles, built once from the property
+// list so an inbound topic is resolved level by level without parsing the
+// payload or scanning properties. Level strings are not copied and must
+// outlive the router.
+class TopicRouter {
+ public:
+  TopicRouter() : count(0), root(-1) {}
+
+  void clear() {
+    count = 0;
+    root = -1;
+  }
+
+  bool empty() const { return count == 0; }
+
+  // first topic level, created if missing
+  RouteNode* top(const char* level) {
+    return insertAt(&root, level);
+  }
+
+  // child of parent named level, created if missing
+  RouteNode* insert(RouteNode* parent, const char* level) {
+    if (parent == nullptr) {
+      return nullptr;
+    }
+    return insertAt(&parent->child, level);
+  }
+
+  // node of the full topic if it has a handler
+  const RouteNode* match(const char* topic) const {
+    int16_t i = root;
+    const RouteNode* node = nullptr;
+    for (;;) {
+      const char* end = strchr(topic, '/');
+      size_t len = end == nullptr ? strlen(topic) : end - topic;
+      while (i >= 0 && (nodes[i].len != len || memcmp(nodes[i].level, topic, len) != 0)) {
+        i = nodes[i].sibling;
+      }
+      if (i < 0) {
+        return nullptr;
+      }
+      node = &nodes[i];
+      if (end == nullptr) {
+        return node->kind == RouteKind::None ? nullptr : node;
+      }
+      topic = end + 1;
+      i = node->child;
+    }
+  }
+
+ private:
+  RouteNode nodes[SENSORA_MAX_ROUTE_NODES];
+  int16_t count;
+  int16_t root;
+
+  RouteNode* insertAt(int16_t* link, const char* level) {
+    size_t len = strlen(level);
+    while (*link >= 0) {
+      RouteNode& n = nodes[*link];
+      if (n.len == len && memcmp(n.level, level, len) == 0) {
+        return &n;
+      }
+      link = &n.sibling;
+    }
+    if (count >= SENSORA_MAX_ROUTE_NODES || len > 255) {
+      SENSORA_LOGE("route table full, increase SENSORA_MAX_ROUTE_NODES");
+      return nullptr;
+    }
+    RouteNode& n = nodes[count];
+    n.level = level;
+    n.len = len;
+    n.child = -1;
+    n.sibling = -1;
+    n.kind = RouteKind::None;
+    n.prop = nullptr;
+    *link = count++;
+    return &n;
+  }
+};
+
+#endif
@@ -19,10 +19,86 @@
 
 #include <ArduinoMqttClient.h>
 
+// Forwards everything to the network client and peeks at the first packet
+// received after connect, which is always the CONNACK (0x20 0x02 flags rc).
+// ArduinoMqttClient does not expose the session present flag.
+class ConnAckClient : public Client {
+ public:
+  ConnAckClient(Client& client) : client(client), ackPos(0), present(false), connectMs(0) {}
+
+  int connect(IPAddress ip, uint16_t port) {
+    reset();
+    unsigned long start = millis();
+    int ret = client.connect(ip, port);
+    connectMs = millis() - start;
+    return ret;
+  }
+
+  int connect(const char* host, uint16_t port) {
+    reset();
+    unsigned long start = millis();
+    int ret = client.connect(host, port);
+    connectMs = millis() - start;
+    return ret;
+  }
+
+  size_t write(uint8_t b) { return client.write(b); }
+  size_t write(const uint8_t* buf, size_t size) { return client.write(buf, size); }
+  int available() { return client.available(); }
+
+  int read() {
+    int b = client.read();
+    if (b >= 0) {
+      inspect(b);
+    }
+    return b;
+  }
+
+  int read(uint8_t* buf, size_t size) {
+    int n = client.read(buf, size);
+    for (int i = 0; i < n; i++) {
+      inspect(buf[i]);
+    }
+    return n;
+  }
+
+  int peek() { return client.peek(); }
+  void flush() { client.flush(); }
+  void stop() { client.stop(); }
+  uint8_t connected() { return client.connected(); }
+  operator bool() { return client; }
+
+  bool sessionPresent() const { return present; }
+  // time spent in the network client connect, including the TLS handshake
+  unsigned long handshakeMs() const { return connectMs; }
+
+ private:
+  Client& client;
+  uint8_t ack[4];
+  uint8_t ackPos;
+  bool present;
+  unsigned long connectMs;
+
+  void reset() {
+    ackPos = 0;
+    present = false;
+  }
+
+  void inspect(uint8_t b) {
+    if (ackPos >= sizeof(ack)) {
+      return;
+    }
+    ack[ackPos++] = b;
+    if (ackPos == sizeof(ack)) {
+      present = ack[0] == 0x20 && ack[1] == 0x02 && (ack[2] & 0x01) && ack[3] == 0x00;
+    }
+  }
+};
+
 template <typename TClient>
 class SensoraTransport {
  public:
-  SensoraTransport(TClient& client) : mqttClient(client) {
+  SensoraTransport(TClient& client) : netClient(client), mqttClient(netClient) {
   }
 
   void setup() {
@@ -30,6 +106,7 @@ class SensoraTransport {
     mqttClient.setId(deviceConfig.deviceId);
     mqttClient.setUsernamePassword("", deviceConfig.deviceToken);
     mqttClient.setKeepAliveInterval(15 * 1000L);
+    mqttClient.setCleanSession(SENSORA_MQTT_CLEAN_SESSION);
     char willTopic[45];
     snprintf(willTopic, sizeof(willTopic), "sc/%s/dev/info", deviceConfig.deviceId);
     SensoraPayload p;
@@ -44,11 +121,11 @@ class SensoraTransport {
     if (mqttClient.connected()) {
       return true;
     }
-    if (!mqttClient.connect(MQTT_HOST, 1883)) {
+    if (!mqttClient.connect(MQTT_HOST, MQTT_PORT)) {
       SENSORA_LOGE("failed to connect to Sensora Cloud, code %d", mqttClient.connectError());
       return false;
     } else {
-      SENSORA_LOGI("connected to Sensora Cloud");
+      SENSORA_LOGI("connected to Sensora Cloud in %lu ms, session present %d", netClient.handshakeMs(), sessionPresent());
       return true;
     }
   }
@@ -73,11 +150,27 @@ class SensoraTransport {
     return mqttClient.subscribe(topic, 1);
   }
 
+  void onMessage(void (*callback)(int)) { mqttClient.onMessage(callback); }
+  void poll() { mqttClient.poll(); }
+  int read() { return mqttClient.read(); }
+  void stop() { mqttClient.stop(); }
+
+  // ArduinoMqttClient only hands out the topic as a String copy, it is
+  // freed right away so it does not fragment the heap
+  const char* messageTopic() {
+    copyString(mqttClient.messageTopic().c_str(), topic);
+    return topic;
+  }
+
   bool connected() { return mqttClient.connected(); }
+  bool sessionPresent() const { return !SENSORA_MQTT_CLEAN_SESSION && netClient.sessionPresent(); }
+  unsigned long handshakeMs() const { return netClient.handshakeMs(); }
   MqttClient& mqtt() { return mqttClient; }
 
  private:
+  ConnAckClient netClient;
   MqttClient mqttClient;
+  char topic[SENSORA_MAX_TOPIC_LEN];
 };
 
 typedef SensoraTransport<Client> Transp;
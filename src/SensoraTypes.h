@@ -0,0 +1,172 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SensoraTypes_h
+#define SensoraTypes_h
+
+// sent as six hex digits, "ff8000"
+struct RgbColor {
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+};
+
+// hue in degrees 0..359, saturation and value 0..255
+struct HsvColor {
+  uint16_t h;
+  uint8_t s;
+  uint8_t v;
+};
+
+// degrees in fixed point with 7 decimals (about 1 cm), sent as "lat,lon"
+struct GeoLocation {
+  int32_t lat;
+  int32_t lon;
+
+  static GeoLocation fromDegrees(double lat, double lon) {
+    GeoLocation l;
+    l.lat = lround(lat * 1e7);
+    l.lon = lround(lon * 1e7);
+    return l;
+  }
+
+  double latitude() const { return lat / 1e7; }
+  double longitude() const { return lon / 1e7; }
+};
+
+RgbColor hsvToRgb(const HsvColor& c) {
+  RgbColor rgb;
+  uint16_t h = c.h % 360;
+  uint8_t region = h / 60;
+  uint16_t rem = (h - region * 60) * 255 / 60;
+  uint8_t p = (c.v * (255 - c.s)) / 255;
+  uint8_t q = (c.v * (255 - (c.s * rem) / 255)) / 255;
+  uint8_t t = (c.v * (255 - (c.s * (255 - rem)) / 255)) / 255;
+  switch (region) {
+    case 0:
+      rgb = {c.v, t, p};
+      break;
+    case 1:
+      rgb = {q, c.v, p};
+      break;
+    case 2:
+      rgb = {p, c.v, t};
+      break;
+    case 3:
+      rgb = {p, q, c.v};
+      break;
+    case 4:
+      rgb = {t, p, c.v};
+      break;
+    default:
+      rgb = {c.v, p, q};
+      break;
+  }
+  return rgb;
+}
+
+HsvColor rgbToHsv(const RgbColor& c) {
+  HsvColor hsv;
+  uint8_t max = c.r > c.g ? (c.r > c.b ? c.r : c.b) : (c.g > c.b ? c.g : c.b);
+  uint8_t min = c.r < c.g ? (c.r < c.b ? c.r : c.b) : (c.g < c.b ? c.g : c.b);
+  uint8_t delta = max - min;
+  hsv.v = max;
+  hsv.s = max == 0 ? 0 : delta * 255 / max;
+  if (delta == 0) {
+    hsv.h = 0;
+  } else if (max == c.r) {
+    hsv.h = (360 + 60 * (c.g - c.b) / delta) % 360;
+  } else if (max == c.g) {
+    hsv.h = 120 + 60 * (c.b - c.r) / delta;
+  } else {
+    hsv.h = 240 + 60 * (c.r - c.g) / delta;
+  }
+  return hsv;
+}
+
+size_t formatColor(const RgbColor& c, char* out) {
+  uint8_t bytes[3] = {c.r, c.g, c.b};
+  return formatHex(bytes, 3, out);
+}
+
+// six hex digits with an optional leading '#'
+bool parseColor(const char* s, RgbColor& c) {
+  if (*s == '#') {
+    s++;
+  }
+  uint8_t bytes[3];
+  if (!parseHex(s, bytes, 3)) {
+    return false;
+  }
+  c = {bytes[0], bytes[1], bytes[2]};
+  return true;
+}
+
+// out must hold 24 bytes
+size_t formatLocation(const GeoLocation& l, char* out) {
+  size_t len = formatInt(l.lat, out);
+  out[len++] = ',';
+  return len + formatInt(l.lon, out + len);
+}
+
+// a signed decimal filling [s, end) that is at most limit in magnitude
+bool parseCoordinate(const char* s, const char* end, int32_t limit, int32_t& v) {
+  bool neg = *s == '-';
+  if (neg) {
+    s++;
+  }
+  if (s == end || end - s > 10) {
+    return false;
+  }
+  int64_t n = 0;
+  for (; s < end; s++) {
+    if (static_cast<uint8_t>(*s - '0') >= 10) {
+      return false;
+    }
+    n = n * 10 + (*s - '0');
+  }
+  if (n > limit) {
+    return false;
+  }
+  v = static_cast<int32_t>(neg ? -n : n);
+  return true;
+}
+
+// "lat,lon" in 1e-7 degrees, l is left alone on failure
+bool parseLocation(const char* s, GeoLocation& l) {
+  const char* comma = strchr(s, ',');
+  if (comma == nullptr) {
+    return false;
+  }
+  GeoLocation p;
+  if (!parseCoordinate(s, comma, 900000000, p.lat) ||
+      !parseCoordinate(comma + 1, comma + 1 + strlen(comma + 1), 1800000000, p.lon)) {
+    return false;
+  }
+  l = p;
+  return true;
+}
+
+// equirectangular approximation, good to well under 1% below 100 km
+float distanceMeters(const GeoLocation& a, const GeoLocation& b) {
+  const float radPerUnit = 1e-7f * 3.14159265f / 180;
+  float meanLat = (static_cast<float>(a.lat) + b.lat) / 2 * radPerUnit;
+  float x = static_cast<float>(static_cast<int64_t>(b.lon) - a.lon) * radPerUnit * cosf(meanLat);
+  float y = static_cast<float>(static_cast<int64_t>(b.lat) - a.lat) * radPerUnit;
+  return 6371000.0f * sqrtf(x * x + y * y);
+}
+
+#endif
@@ -17,6 +17,8 @@
 #ifndef SensoraUtil_h
 #define SensoraUtil_h
 
+#include <math.h>
+
 template <typename T, size_t N>
 void copyString(const char* source, T (&dest)[N]) {
   strncpy(dest, source, N);
@@ -52,21 +54,6 @@ bool validateWiFiCredentials(const char* ssid, const char* password) {
   return true;
 }
 
-void extractDeviceId(const char* topic, char* deviceId) {
-  SENSORA_LOGV("parse topic '%s'", topic);
-  const char* cursor = topic + 3;
-  size_t length = 0;
-
-  char* slashPtr = strchr(cursor, '/');
-  if (slashPtr == NULL) {
-    SENSORA_LOGE("Cannot extract deviceId from topic");
-    return;
-  }
-  length = slashPtr - cursor;
-  memcpy(deviceId, cursor, length);
-  deviceId[length] = '\0';
-}
-
 bool extractPayload(const uint8_t* bytes, int length, const char* key, char* buff, size_t bufLen) {
   int keyLen = strlen(key);
   int i = 0;
@@ -91,6 +78,299 @@ bool extractPayload(const uint8_t* bytes, int length, const char* key, char* buf
   return false;
 }
 
+uint32_t computeCrc32(const uint8_t* data, size_t len, uint32_t crc = 0) {
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t b = 0; b < 8; b++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+const char hexDigits[] = "0123456789abcdef";
+const char hexDigitsUpper[] = "0123456789ABCDEF";
+
+// writes two digits per byte, out must hold 2 * len + 1 bytes or 3 * len
+// with a separator between bytes
+size_t formatHex(const uint8_t* data, size_t len, char* out, char separator = '\0', bool upper = false) {
+  const char* hex = upper ? hexDigitsUpper : hexDigits;
+  size_t n = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (i > 0 && separator != '\0') {
+      out[n++] = separator;
+    }
+    out[n++] = hex[data[i] >> 4];
+    out[n++] = hex[data[i] & 0xf];
+  }
+  out[n] = '\0';
+  return n;
+}
+
+// reads exactly 2 * len digits of either case, out is left alone on failure
+bool parseHex(const char* s, uint8_t* out, size_t len) {
+  if (strlen(s) != 2 * len) {
+    return false;
+  }
+  for (size_t i = 0; i < 2 * len; i++) {
+    char c = s[i] | 0x20;
+    if (!(c >= '0' && c <= '9') && !(c >= 'a' && c <= 'f')) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < len; i++) {
+    uint8_t n = 0;
+    for (int j = 0; j < 2; j++) {
+      char c = s[2 * i + j] | 0x20;
+      n = n << 4 | (c <= '9' ? c - '0' : c - 'a' + 10);
+    }
+    out[i] = n;
+  }
+  return true;
+}
+
+const char digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+const uint32_t uintPow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+const float floatPow10[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+// writes the digits of v two at a time, out must hold 21 bytes
+template <typename T>
+size_t formatUnsigned(T v, char* out) {
+  char tmp[20];
+  char* p = tmp + sizeof(tmp);
+  while (v >= 100) {
+    T q = v / 100;
+    p -= 2;
+    memcpy(p, digitPairs + 2 * (v - q * 100), 2);
+    v = q;
+  }
+  if (v >= 10) {
+    p -= 2;
+    memcpy(p, digitPairs + 2 * v, 2);
+  } else {
+    *--p = '0' + v;
+  }
+  size_t len = tmp + sizeof(tmp) - p;
+  memcpy(out, p, len);
+  out[len] = '\0';
+  return len;
+}
+
+size_t formatUInt(uint32_t v, char* out) {
+  return formatUnsigned(v, out);
+}
+
+// out must hold 12 bytes
+size_t formatInt(int32_t v, char* out) {
+  if (v < 0) {
+    *out = '-';
+    return 1 + formatUnsigned(0u - static_cast<uint32_t>(v), out + 1);
+  }
+  return formatUnsigned(static_cast<uint32_t>(v), out);
+}
+
+// same output as printf("%.*f", decimals, v), returns the length printf would
+// return. Values too large for exact integer math fall back to snprintf.
+size_t formatFixed(double v, uint8_t decimals, char* out, size_t size) {
+  double a = fabs(v);
+  if (decimals > 9 || !(a * uintPow10[decimals < 9 ? decimals : 9] < 4503599627370496.0)) {
+    return snprintf(out, size, "%.*f", decimals, v);
+  }
+  // p + err is the exact product, round it half to even like printf
+  double scale = uintPow10[decimals];
+  double p = a * scale;
+  double err = fma(a, scale, -p);
+  double r = floor(p);
+  double half = (p - r) - 0.5 + err;
+  uint64_t u = static_cast<uint64_t>(r);
+  if (half > 0 || (half == 0 && (u & 1))) {
+    u++;
+  }
+  char tmp[32];
+  size_t len = 0;
+  if (signbit(v)) {
+    tmp[len++] = '-';
+  }
+  len += formatUnsigned(u / uintPow10[decimals], tmp + len);
+  if (decimals > 0) {
+    tmp[len++] = '.';
+    uint32_t frac = u % uintPow10[decimals];
+    for (int i = decimals - 1; i >= 0; i--) {
+      tmp[len + i] = '0' + frac % 10;
+      frac /= 10;
+    }
+    len += decimals;
+  }
+  tmp[len] = '\0';
+  if (size > 0) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(out, tmp, n);
+    out[n] = '\0';
+  }
+  return len;
+}
+
+// atoi without locale handling, overflow wraps
+int32_t parseInt(const char* s) {
+  while (*s == ' ' || (*s >= '\t' && *s <= '\r')) {
+    s++;
+  }
+  bool neg = *s == '-';
+  if (*s == '-' || *s == '+') {
+    s++;
+  }
+  uint32_t v = 0;
+  while (static_cast<uint8_t>(*s - '0') < 10) {
+    v = v * 10 + (*s++ - '0');
+  }
+  return static_cast<int32_t>(neg ? 0u - v : v);
+}
+
+// correctly rounded like strtof, short decimals such as "21.5" are converted
+// with a single float divide of two exact values, anything else goes to
+// strtof. Going through strtod would round twice
+float parseFloat(const char* s) {
+  const char* c = s;
+  while (*c == ' ' || (*c >= '\t' && *c <= '\r')) {
+    c++;
+  }
+  bool neg = *c == '-';
+  if (*c == '-' || *c == '+') {
+    c++;
+  }
+  const char* start = c;
+  uint32_t m = 0;
+  int digits = 0;
+  int exp10 = 0;
+  for (; static_cast<uint8_t>(*c - '0') < 10; c++) {
+    if (m == 0 && *c == '0') {
+      continue;
+    }
+    if (++digits > 8) {
+      return strtof(s, nullptr);
+    }
+    m = m * 10 + (*c - '0');
+  }
+  if (*c == '.') {
+    for (c++; static_cast<uint8_t>(*c - '0') < 10; c++) {
+      if (m == 0 && *c == '0') {
+        exp10--;
+        continue;
+      }
+      if (++digits > 8) {
+        return strtof(s, nullptr);
+      }
+      m = m * 10 + (*c - '0');
+      exp10--;
+    }
+  }
+  if (c == start || *c == 'e' || *c == 'E' || m > (1UL << 24) || exp10 < -10) {
+    return strtof(s, nullptr);
+  }
+  float v = m;
+  if (exp10 < 0) {
+    v /= floatPow10[-exp10];
+  }
+  return neg ? -v : v;
+}
+
+double decimalPow10(int k) {
+  static const double exact[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  if (k >= 0 && k <= 22) {
+    return exact[k];
+  }
+  if (k < 0 && k >= -22) {
+    return 1 / exact[-k];
+  }
+  return pow(10.0, k);
+}
+
+// shortest decimal that parses back to the same float, out must hold 16 bytes
+size_t formatFloat(float v, char* out) {
+  if (!isfinite(v)) {
+    return snprintf(out, 16, "%s", isnan(v) ? "nan" : (v < 0 ? "-inf" : "inf"));
+  }
+  size_t len = 0;
+  if (signbit(v)) {
+    out[len++] = '-';
+  }
+  double a = fabs(static_cast<double>(v));
+  if (a == 0) {
+    out[len++] = '0';
+    out[len] = '\0';
+    return len;
+  }
+  int e0 = floor(log10(a));
+  for (int p = 1; p <= 9; p++) {
+    // rounding to p digits may carry into a new digit, which only holds for
+    // this precision
+    int e = e0;
+    double scaled = a * decimalPow10(p - 1 - e);
+    uint32_t d = static_cast<uint32_t>(scaled + 0.5);
+    if (d >= uintPow10[p]) {
+      e++;
+      scaled = a * decimalPow10(p - 1 - e);
+      d = static_cast<uint32_t>(scaled + 0.5);
+    } else if (d < uintPow10[p - 1]) {
+      e--;
+      scaled = a * decimalPow10(p - 1 - e);
+      d = static_cast<uint32_t>(scaled + 0.5);
+    }
+    // d has p digits and the decimal point goes after digit e + 1
+    char digits[11];
+    int used = formatUnsigned(d, digits);
+    while (used > 1 && digits[used - 1] == '0') {
+      used--;
+    }
+    size_t n = len;
+    if (e >= -4 && e < 9) {
+      if (e < 0) {
+        out[n++] = '0';
+        out[n++] = '.';
+        for (int i = -1; i > e; i--) {
+          out[n++] = '0';
+        }
+        memcpy(out + n, digits, used);
+        n += used;
+      } else {
+        for (int i = 0; i <= e || i < used; i++) {
+          if (i == e + 1) {
+            out[n++] = '.';
+          }
+          out[n++] = i < used ? digits[i] : '0';
+        }
+      }
+    } else {
+      out[n++] = digits[0];
+      if (used > 1) {
+        out[n++] = '.';
+        memcpy(out + n, digits + 1, used - 1);
+        n += used - 1;
+      }
+      out[n++] = 'e';
+      n += formatInt(e, out + n);
+    }
+    out[n] = '\0';
+    if (parseFloat(out) == v) {
+      return n;
+    }
+  }
+  return snprintf(out, 16, "%.9g", v);
+}
+
 void printLogo() {
   SENSORA_LOGW("*******************************************************");
   SENSORA_LOGW("*  ____                                               *");
@@ -0,0 +1,195 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SensoraWindow_h
+#define SensoraWindow_h
+
+enum class Aggregation {
+  None,
+  Mean,
+  Min,
+  Max,
+  Count,
+  Sum,
+  Ema,
+  Percentile
+};
+
+// Streaming aggregate over the samples of one sync window, every operator
+// is O(1) in time and memory per sample. Percentile uses the P-square
+// estimator, Ema carries over between windows.
+class AggregateWindow {
+ public:
+  AggregateWindow() : op(Aggregation::None), param(0), ema(0), emaSeeded(false) {
+    reset();
+  }
+
+  // param is the smoothing factor for Ema and the quantile (0..1) for Percentile
+  void begin(Aggregation o, float p) {
+    op = o;
+    param = p;
+    emaSeeded = false;
+    reset();
+  }
+
+  Aggregation getOp() const { return op; }
+  uint32_t count() const { return n; }
+
+  void add(float x) {
+    if (n == 0 || x < lo) {
+      lo = x;
+    }
+    if (n == 0 || x > hi) {
+      hi = x;
+    }
+    sum += x;
+    n++;
+    if (op == Aggregation::Ema) {
+      ema = emaSeeded ? ema + param * (x - ema) : x;
+      emaSeeded = true;
+    } else if (op == Aggregation::Percentile) {
+      addQuantile(x);
+    }
+  }
+
+  float result() const {
+    switch (op) {
+      case Aggregation::Mean:
+        return n > 0 ? sum / n : 0;
+      case Aggregation::Min:
+        return lo;
+      case Aggregation::Max:
+        return hi;
+      case Aggregation::Count:
+        return n;
+      case Aggregation::Sum:
+        return sum;
+      case Aggregation::Ema:
+        return ema;
+      case Aggregation::Percentile:
+        return quantile();
+      default:
+        return 0;
+    }
+  }
+
+  void reset() {
+    n = 0;
+    sum = lo = hi = 0;
+  }
+
+ private:
+  Aggregation op;
+  float param;
+  uint32_t n;
+  float sum;
+  float lo;
+  float hi;
+  float ema;
+  bool emaSeeded;
+
+  // P-square markers: heights, positions and desired positions
+  float q[5];
+  int32_t pos[5];
+  float want[5];
+
+  void addQuantile(float x) {
+    if (n <= 5) {
+      q[n - 1] = x;
+      if (n == 5) {
+        sortMarkers(q, 5);
+        for (int i = 0; i < 5; i++) {
+          pos[i] = i;
+        }
+        want[0] = 0;
+        want[1] = 2 * param;
+        want[2] = 4 * param;
+        want[3] = 2 + 2 * param;
+        want[4] = 4;
+      }
+      return;
+    }
+
+    int k;
+    if (x < q[0]) {
+      q[0] = x;
+      k = 0;
+    } else if (x >= q[4]) {
+      q[4] = x;
+      k = 3;
+    } else {
+      k = 0;
+      while (x >= q[k + 1]) {
+        k++;
+      }
+    }
+    for (int i = k + 1; i < 5; i++) {
+      pos[i]++;
+    }
+    want[1] += param / 2;
+    want[2] += param;
+    want[3] += (1 + param) / 2;
+    want[4] += 1;
+
+    for (int i = 1; i < 4; i++) {
+      float d = want[i] - pos[i];
+      if ((d >= 1 && pos[i + 1] - pos[i] > 1) || (d <= -1 && pos[i - 1] - pos[i] < -1)) {
+        int s = d >= 0 ? 1 : -1;
+        float h = parabolic(i, s);
+        if (q[i - 1] < h && h < q[i + 1]) {
+          q[i] = h;
+        } else {
+          q[i] += s * (q[i + s] - q[i]) / (pos[i + s] - pos[i]);
+        }
+        pos[i] += s;
+      }
+    }
+  }
+
+  float parabolic(int i, int s) const {
+    float a = static_cast<float>(s) / (pos[i + 1] - pos[i - 1]);
+    float b = (pos[i] - pos[i - 1] + s) * (q[i + 1] - q[i]) / (pos[i + 1] - pos[i]);
+    float c = (pos[i + 1] - pos[i] - s) * (q[i] - q[i - 1]) / (pos[i] - pos[i - 1]);
+    return q[i] + a * (b + c);
+  }
+
+  float quantile() const {
+    if (n == 0) {
+      return 0;
+    }
+    if (n >= 5) {
+      return q[2];
+    }
+    // too few samples for the markers, pick from the sorted samples
+    float v[5];
+    memcpy(v, q, n * sizeof(float));
+    sortMarkers(v, n);
+    return v[static_cast<uint32_t>(param * (n - 1) + 0.5f)];
+  }
+
+  static void sortMarkers(float* v, uint32_t len) {
+    for (uint32_t i = 1; i < len; i++) {
+      float x = v[i];
+      uint32_t j = i;
+      for (; j > 0 && v[j - 1] > x; j--) {
+        v[j] = v[j - 1];
+      }
+      v[j] = x;
+    }
+  }
+};
+
+#endif
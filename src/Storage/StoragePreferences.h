@@ -19,25 +19,226 @@
 
 #include <Preferences.h>
 
+#define STORAGE_RECORD_MAGIC 0x5352
+#define STORAGE_RECORD_VERSION 1
+#define STORAGE_MAX_KEY_LEN 14
+
+// Every key is stored in two alternating slots ("<key>0" and "<key>1"), each
+// record carries a sequence number and a CRC. Reads pick the newest valid
+// slot, so a torn write falls back to the previous value.
+struct StorageRecordHeader {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t slot;
+  uint32_t seq;
+  uint32_t crc;
+  uint16_t len;
+};
+
+// Writes are coalesced in RAM and flushed from storageLoop()
+// STORAGE_FLUSH_DELAY_MS after the first write since the last flush, so a
+// key written all the time still reaches flash on schedule.
+struct StorageCacheEntry {
+  char key[STORAGE_MAX_KEY_LEN + 1];
+  uint8_t data[STORAGE_RECORD_SIZE];
+  uint16_t len;
+  uint32_t seq;
+  uint8_t slot;
+  bool dirty;
+  unsigned long dirtyAt;
+};
+
 Preferences preferences;
+StorageCacheEntry storageCache[STORAGE_CACHE_ENTRIES];
 
 void storageBegin() {
   preferences.begin("sensora", false);
 }
 
+// with create, a full cache evicts a flushed entry; returns nullptr only if
+// every entry still holds an unflushed write
+StorageCacheEntry* storageEntry(const char* key, bool create) {
+  StorageCacheEntry* empty = nullptr;
+  StorageCacheEntry* clean = nullptr;
+  for (StorageCacheEntry& e : storageCache) {
+    if (e.key[0] == '\0') {
+      if (empty == nullptr) {
+        empty = &e;
+      }
+      continue;
+    }
+    if (strcmp(e.key, key) == 0) {
+      return &e;
+    }
+    if (!e.dirty && clean == nullptr) {
+      clean = &e;
+    }
+  }
+  if (empty == nullptr) {
+    empty = clean;
+  }
+  if (!create || empty == nullptr) {
+    return nullptr;
+  }
+  copyString(key, empty->key);
+  empty->len = 0;
+  empty->seq = 0;
+  empty->slot = 1;
+  empty->dirty = false;
+  return empty;
+}
+
+bool storageReadSlot(const char* key, uint8_t slot, StorageRecordHeader& header, uint8_t* data, size_t len) {
+  char slotKey[STORAGE_MAX_KEY_LEN + 2];
+  snprintf(slotKey, sizeof(slotKey), "%s%c", key, '0' + (slot & 1));
+  uint8_t record[sizeof(StorageRecordHeader) + STORAGE_RECORD_SIZE];
+  size_t readBytes = preferences.getBytes(slotKey, record, sizeof(StorageRecordHeader) + len);
+  if (readBytes != sizeof(StorageRecordHeader) + len) {
+    return false;
+  }
+  memcpy(&header, record, sizeof(StorageRecordHeader));
+  if (header.magic != STORAGE_RECORD_MAGIC || header.version != STORAGE_RECORD_VERSION || header.len != len) {
+    return false;
+  }
+  if (computeCrc32(record + sizeof(StorageRecordHeader), len) != header.crc) {
+    SENSORA_LOGW("storage key '%s' slot %u failed crc check", key, slot);
+    return false;
+  }
+  memcpy(data, record + sizeof(StorageRecordHeader), len);
+  return true;
+}
+
+bool storageWriteSlot(StorageCacheEntry& e) {
+  uint8_t slot = e.slot ^ 1;
+  char slotKey[STORAGE_MAX_KEY_LEN + 2];
+  snprintf(slotKey, sizeof(slotKey), "%s%c", e.key, '0' + (slot & 1));
+  StorageRecordHeader header = {STORAGE_RECORD_MAGIC, STORAGE_RECORD_VERSION, slot, e.seq + 1, computeCrc32(e.data, e.len), e.len};
+  uint8_t record[sizeof(StorageRecordHeader) + STORAGE_RECORD_SIZE];
+  memcpy(record, &header, sizeof(StorageRecordHeader));
+  memcpy(record + sizeof(StorageRecordHeader), e.data, e.len);
+  if (preferences.putBytes(slotKey, record, sizeof(StorageRecordHeader) + e.len) != sizeof(StorageRecordHeader) + e.len) {
+    SENSORA_LOGE("failed to write storage key '%s'", e.key);
+    return false;
+  }
+  e.seq = header.seq;
+  e.slot = slot;
+  e.dirty = false;
+  return true;
+}
+
+// newest valid slot of key, -1 if neither slot holds a valid record
+int storageReadNewest(const char* key, StorageRecordHeader& header, uint8_t* data, size_t len) {
+  StorageRecordHeader headers[2];
+  uint8_t slotData[2][STORAGE_RECORD_SIZE];
+  bool valid[2];
+  for (uint8_t slot = 0; slot < 2; slot++) {
+    valid[slot] = storageReadSlot(key, slot, headers[slot], slotData[slot], len);
+  }
+  if (!valid[0] && !valid[1]) {
+    return -1;
+  }
+  uint8_t newest = !valid[0] || (valid[1] && (int32_t)(headers[1].seq - headers[0].seq) > 0) ? 1 : 0;
+  header = headers[newest];
+  memcpy(data, slotData[newest], len);
+  return newest;
+}
+
+bool storageRead(const char* key, uint8_t* data, size_t len) {
+  if (len > STORAGE_RECORD_SIZE || strlen(key) > STORAGE_MAX_KEY_LEN) {
+    SENSORA_LOGE("storage key '%s' too long or record too large", key);
+    return false;
+  }
+  StorageCacheEntry* e = storageEntry(key, false);
+  if (e != nullptr && e->len == len) {
+    memcpy(data, e->data, len);
+    return true;
+  }
+
+  StorageRecordHeader header;
+  int newest = storageReadNewest(key, header, data, len);
+  if (newest < 0) {
+    // records written before versioning were raw structs under the plain key
+    return preferences.getBytes(key, data, len) == len;
+  }
+
+  e = storageEntry(key, true);
+  if (e != nullptr) {
+    memcpy(e->data, data, len);
+    e->len = len;
+    e->seq = header.seq;
+    e->slot = newest;
+  }
+  return true;
+}
+
+void storageWrite(const char* key, const uint8_t* data, size_t len) {
+  if (len > STORAGE_RECORD_SIZE || strlen(key) > STORAGE_MAX_KEY_LEN) {
+    SENSORA_LOGE("storage key '%s' too long or record too large", key);
+    return;
+  }
+  StorageCacheEntry* e = storageEntry(key, false);
+  if (e == nullptr) {
+    // load the current slot and sequence so the write lands in the other slot
+    uint8_t current[STORAGE_RECORD_SIZE];
+    storageRead(key, current, len);
+    e = storageEntry(key, true);
+  }
+  if (e == nullptr) {
+    // every entry is waiting to be flushed, write through after the slot
+    // and sequence currently in flash
+    StorageCacheEntry tmp;
+    StorageRecordHeader header;
+    copyString(key, tmp.key);
+    int current = storageReadNewest(key, header, tmp.data, len);
+    tmp.seq = current < 0 ? 0 : header.seq;
+    tmp.slot = current < 0 ? 1 : current;
+    memcpy(tmp.data, data, len);
+    tmp.len = len;
+    storageWriteSlot(tmp);
+    return;
+  }
+  if (e->len == len && memcmp(e->data, data, len) == 0) {
+    return;
+  }
+  memcpy(e->data, data, len);
+  e->len = len;
+  if (!e->dirty) {
+    e->dirty = true;
+    e->dirtyAt = millis();
+  }
+}
+
+void storageFlush() {
+  for (StorageCacheEntry& e : storageCache) {
+    if (e.dirty) {
+      storageWriteSlot(e);
+    }
+  }
+}
+
+// flushes at most one record per call to bound the time spent in loop()
+void storageLoop() {
+  for (StorageCacheEntry& e : storageCache) {
+    if (e.dirty && millis() - e.dirtyAt >= STORAGE_FLUSH_DELAY_MS) {
+      storageWriteSlot(e);
+      return;
+    }
+  }
+}
+
 void storageEnd() {
+  storageFlush();
   preferences.end();
 }
 
 template<typename T>
 bool readConfig(const char* key, T& config) {
-  size_t readBytes = preferences.getBytes(key, &config, sizeof(T));
-  return readBytes == sizeof(T);
+  return storageRead(key, reinterpret_cast<uint8_t*>(&config), sizeof(T));
 }
 
 template<typename T>
 void writeConfig(const char* key, const T& config) {
-  preferences.putBytes(key, &config, sizeof(T));
+  storageWrite(key, reinterpret_cast<const uint8_t*>(&config), sizeof(T));
 }
 
 #endif
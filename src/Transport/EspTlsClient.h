@@ -0,0 +1,190 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EspTlsClient_h
+#define EspTlsClient_h
+
+#include <esp_tls.h>
+#include <lwip/sockets.h>
+
+#ifndef SENSORA_TLS_HANDSHAKE_TIMEOUT_MS
+#define SENSORA_TLS_HANDSHAKE_TIMEOUT_MS 10000
+#endif
+
+#ifndef SENSORA_TLS_WRITE_TIMEOUT_MS
+#define SENSORA_TLS_WRITE_TIMEOUT_MS 5000
+#endif
+
+#define TLS_RX_BUFFER_SIZE 64
+
+// TLS client on top of esp-tls. Unlike WiFiClientSecure it keeps the session
+// ticket of the last connection in RAM and offers it on the next connect, so
+// a reconnect to the same broker skips the certificate exchange and key
+// agreement.
+class EspTlsClient : public Client {
+ public:
+  EspTlsClient(const char* caCert = nullptr) : tls(nullptr), session(nullptr), caCert(caCert), hostname(nullptr), rxLen(0), rxPos(0), closed(true) {}
+
+  void setCACert(const char* cert) { caCert = cert; }
+
+  // name the server certificate is checked against when connecting by ip
+  void setHostname(const char* name) { hostname = name; }
+
+  int connect(IPAddress ip, uint16_t port) {
+    if (caCert != nullptr && hostname == nullptr) {
+      SENSORA_LOGE("cannot verify the certificate of a server given by ip, call setHostname() first");
+      return 0;
+    }
+    char host[16];
+    snprintf(host, sizeof(host), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    return open(host, hostname, port);
+  }
+
+  int connect(const char* host, uint16_t port) {
+    return open(host, host, port);
+  }
+
+  size_t write(uint8_t b) { return write(&b, 1); }
+
+  size_t write(const uint8_t* buf, size_t size) {
+    size_t sent = 0;
+    unsigned long start = millis();
+    while (!closed && sent < size) {
+      ssize_t n = esp_tls_conn_write(tls, buf + sent, size - sent);
+      if (n > 0) {
+        sent += n;
+      } else if (n != ESP_TLS_ERR_SSL_WANT_READ && n != ESP_TLS_ERR_SSL_WANT_WRITE) {
+        closed = true;
+      } else if (millis() - start >= SENSORA_TLS_WRITE_TIMEOUT_MS) {
+        SENSORA_LOGE("tls write timed out");
+        closed = true;
+      } else {
+        delay(1);
+      }
+    }
+    return sent;
+  }
+
+  int available() {
+    if (rxPos < rxLen || closed) {
+      return rxLen - rxPos;
+    }
+    ssize_t n = esp_tls_conn_read(tls, rxBuf, sizeof(rxBuf));
+    if (n > 0) {
+      rxPos = 0;
+      rxLen = n;
+    } else if (n == 0 || (n != ESP_TLS_ERR_SSL_WANT_READ && n != ESP_TLS_ERR_SSL_WANT_WRITE)) {
+      closed = true;
+    }
+    return rxLen - rxPos;
+  }
+
+  int read() {
+    if (available() <= 0) {
+      return -1;
+    }
+    return rxBuf[rxPos++];
+  }
+
+  int read(uint8_t* buf, size_t size) {
+    int n = available();
+    if (n <= 0) {
+      return -1;
+    }
+    if (static_cast<size_t>(n) > size) {
+      n = size;
+    }
+    memcpy(buf, rxBuf + rxPos, n);
+    rxPos += n;
+    return n;
+  }
+
+  int peek() {
+    if (available() <= 0) {
+      return -1;
+    }
+    return rxBuf[rxPos];
+  }
+
+  void flush() {}
+
+  void stop() {
+    if (tls != nullptr) {
+      esp_tls_conn_destroy(tls);
+      tls = nullptr;
+    }
+    rxLen = rxPos = 0;
+    closed = true;
+  }
+
+  uint8_t connected() { return tls != nullptr && (!closed || rxPos < rxLen); }
+  operator bool() { return connected(); }
+
+ private:
+  esp_tls_t* tls;
+  void* session;
+  const char* caCert;
+  const char* hostname;
+  uint8_t rxBuf[TLS_RX_BUFFER_SIZE];
+  size_t rxLen;
+  size_t rxPos;
+  bool closed;
+
+  int open(const char* host, const char* commonName, uint16_t port) {
+    stop();
+    tls = esp_tls_init();
+    if (tls == nullptr) {
+      return 0;
+    }
+    esp_tls_cfg_t cfg = {};
+    if (caCert != nullptr) {
+      cfg.cacert_buf = reinterpret_cast<const unsigned char*>(caCert);
+      cfg.cacert_bytes = strlen(caCert) + 1;
+    }
+    cfg.common_name = commonName;
+    cfg.timeout_ms = SENSORA_TLS_HANDSHAKE_TIMEOUT_MS;
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    cfg.client_session = static_cast<esp_tls_client_session_t*>(session);
+#endif
+    if (esp_tls_conn_new_sync(host, strlen(host), port, &cfg, tls) != 1) {
+      SENSORA_LOGE("tls handshake with '%s' failed", host);
+      dropSession();
+      stop();
+      return 0;
+    }
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    dropSession();
+    session = esp_tls_get_client_session(tls);
+#endif
+    int fd;
+    if (esp_tls_get_conn_sockfd(tls, &fd) == ESP_OK) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+    closed = false;
+    return 1;
+  }
+
+  void dropSession() {
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    if (session != nullptr) {
+      esp_tls_free_client_session(static_cast<esp_tls_client_session_t*>(session));
+      session = nullptr;
+    }
+#endif
+  }
+};
+
+#endif
@@ -0,0 +1,204 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LoopbackTransport_h
+#define LoopbackTransport_h
+
+#ifndef SENSORA_LOOPBACK_QUEUE_SIZE
+#define SENSORA_LOOPBACK_QUEUE_SIZE 8
+#endif
+
+#ifndef SENSORA_LOOPBACK_MAX_SUBSCRIPTIONS
+#define SENSORA_LOOPBACK_MAX_SUBSCRIPTIONS 8
+#endif
+
+struct LoopbackMessage {
+  char topic[SENSORA_MAX_TOPIC_LEN];
+  uint8_t payload[SENSORA_PAYLOAD_SIZE];
+  size_t len;
+};
+
+// In-memory transport for running a device without a network. Published
+// messages are kept for inspection and messages passed to deliver() reach
+// the device on the next poll() if it subscribed to the topic.
+class LoopbackTransport {
+ public:
+  LoopbackTransport()
+      : online(true), isConnected(false), persistent(false), callback(nullptr), subCount(0), sentTotal(0), inHead(0), inCount(0), rxLen(0), rxPos(0) {
+    rxTopic[0] = '\0';
+  }
+
+  void setup() {}
+
+  bool connect() {
+    isConnected = online;
+    return isConnected;
+  }
+
+  // simulates losing or regaining the broker
+  void setOnline(bool o) {
+    online = o;
+    if (!online) {
+      isConnected = false;
+    }
+  }
+
+  // keeps subscriptions across stop() and reconnects like a broker session
+  // without clean session
+  void setPersistentSession(bool p) { persistent = p; }
+
+  bool publish(const char* topic, const uint8_t* buf, unsigned long size) {
+    if (!isConnected || size == 0 || size > SENSORA_PAYLOAD_SIZE) {
+      return false;
+    }
+    LoopbackMessage& m = sentMessages[sentTotal % SENSORA_LOOPBACK_QUEUE_SIZE];
+    copyString(topic, m.topic);
+    memcpy(m.payload, buf, size);
+    m.len = size;
+    sentTotal++;
+    return true;
+  }
+
+  int subscribe(const char* topic) {
+    if (!isConnected) {
+      return 0;
+    }
+    for (uint8_t i = 0; i < subCount; i++) {
+      if (strcmp(subscriptions[i], topic) == 0) {
+        return 1;
+      }
+    }
+    if (subCount >= SENSORA_LOOPBACK_MAX_SUBSCRIPTIONS) {
+      return 0;
+    }
+    copyString(topic, subscriptions[subCount++]);
+    return 1;
+  }
+
+  bool deliver(const char* topic, const uint8_t* buf, size_t size) {
+    if (inCount >= SENSORA_LOOPBACK_QUEUE_SIZE || size > SENSORA_PAYLOAD_SIZE) {
+      return false;
+    }
+    LoopbackMessage& m = inbound[(inHead + inCount) % SENSORA_LOOPBACK_QUEUE_SIZE];
+    copyString(topic, m.topic);
+    memcpy(m.payload, buf, size);
+    m.len = size;
+    inCount++;
+    return true;
+  }
+
+  void poll() {
+    while (inCount > 0) {
+      LoopbackMessage& m = inbound[inHead];
+      inHead = (inHead + 1) % SENSORA_LOOPBACK_QUEUE_SIZE;
+      inCount--;
+      if (!isSubscribed(m.topic)) {
+        continue;
+      }
+      copyString(m.topic, rxTopic);
+      memcpy(rxBuf, m.payload, m.len);
+      rxLen = m.len;
+      rxPos = 0;
+      if (callback != nullptr) {
+        callback(rxLen);
+      }
+    }
+  }
+
+  void stop() {
+    isConnected = false;
+    if (!persistent) {
+      subCount = 0;
+    }
+  }
+
+  void onMessage(void (*cb)(int)) { callback = cb; }
+  const char* messageTopic() { return rxTopic; }
+
+  int read() {
+    if (rxPos >= rxLen) {
+      return -1;
+    }
+    return rxBuf[rxPos++];
+  }
+
+  bool connected() { return isConnected; }
+  bool sessionPresent() const { return persistent && subCount > 0; }
+  unsigned long handshakeMs() const { return 0; }
+
+  unsigned long sentCount() const { return sentTotal; }
+
+  // i = 0 is the most recent message
+  const LoopbackMessage* sent(unsigned long i) const {
+    if (i >= sentTotal || i >= SENSORA_LOOPBACK_QUEUE_SIZE) {
+      return nullptr;
+    }
+    return &sentMessages[(sentTotal - 1 - i) % SENSORA_LOOPBACK_QUEUE_SIZE];
+  }
+
+  bool isSubscribed(const char* topic) const {
+    for (uint8_t i = 0; i < subCount; i++) {
+      if (topicMatches(subscriptions[i], topic)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  bool online;
+  bool isConnected;
+  bool persistent;
+  void (*callback)(int);
+
+  char subscriptions[SENSORA_LOOPBACK_MAX_SUBSCRIPTIONS][SENSORA_MAX_TOPIC_LEN];
+  uint8_t subCount;
+
+  LoopbackMessage sentMessages[SENSORA_LOOPBACK_QUEUE_SIZE];
+  unsigned long sentTotal;
+
+  LoopbackMessage inbound[SENSORA_LOOPBACK_QUEUE_SIZE];
+  uint8_t inHead;
+  uint8_t inCount;
+
+  char rxTopic[SENSORA_MAX_TOPIC_LEN];
+  uint8_t rxBuf[SENSORA_PAYLOAD_SIZE];
+  size_t rxLen;
+  size_t rxPos;
+
+  static bool topicMatches(const char* filter, const char* topic) {
+    while (*filter && *topic) {
+      if (*filter == '#') {
+        return true;
+      }
+      if (*filter == '+') {
+        while (*topic && *topic != '/') {
+          topic++;
+        }
+        filter++;
+        continue;
+      }
+      if (*filter != *topic) {
+        return false;
+      }
+      filter++;
+      topic++;
+    }
+    return (*filter == '\0' || *filter == '#') && *topic == '\0';
+  }
+};
+
+#endif
@@ -0,0 +1,549 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MqttSnTransport_h
+#define MqttSnTransport_h
+
+#ifndef SENSORA_MQTTSN_HOST
+#define SENSORA_MQTTSN_HOST MQTT_HOST
+#endif
+
+#ifndef SENSORA_MQTTSN_PORT
+#define SENSORA_MQTTSN_PORT 1884
+#endif
+
+#ifndef SENSORA_MQTTSN_LOCAL_PORT
+#define SENSORA_MQTTSN_LOCAL_PORT 1884
+#endif
+
+// -1 publishes without a connection and needs topics predefined on the gateway
+#ifndef SENSORA_MQTTSN_QOS
+#define SENSORA_MQTTSN_QOS 0
+#endif
+
+#ifndef SENSORA_MQTTSN_MAX_TOPICS
+#define SENSORA_MQTTSN_MAX_TOPICS 8
+#endif
+
+#ifndef SENSORA_MQTTSN_PACKET_SIZE
+#define SENSORA_MQTTSN_PACKET_SIZE 192
+#endif
+
+// inbound publishes held until poll() hands them to the device
+#ifndef SENSORA_MQTTSN_RX_QUEUE_SIZE
+#define SENSORA_MQTTSN_RX_QUEUE_SIZE 2
+#endif
+
+#define MQTTSN_RETRY_TIMEOUT_MS 2000
+#define MQTTSN_RETRIES 3
+#define MQTTSN_KEEP_ALIVE_S 15
+
+enum class MqttSnMsg : uint8_t {
+  Connect = 0x04,
+  ConnAck = 0x05,
+  WillTopicReq = 0x06,
+  WillTopic = 0x07,
+  WillMsgReq = 0x08,
+  WillMsg = 0x09,
+  Register = 0x0A,
+  RegAck = 0x0B,
+  Publish = 0x0C,
+  PubAck = 0x0D,
+  Subscribe = 0x12,
+  SubAck = 0x13,
+  PingReq = 0x16,
+  PingResp = 0x17,
+  Disconnect = 0x18,
+};
+
+#define MQTTSN_FLAG_DUP 0x80
+#define MQTTSN_FLAG_QOS_1 0x20
+#define MQTTSN_FLAG_QOS_M1 0x60
+#define MQTTSN_FLAG_RETAIN 0x10
+#define MQTTSN_FLAG_WILL 0x08
+#define MQTTSN_FLAG_CLEAN 0x04
+#define MQTTSN_TOPIC_NORMAL 0x00
+#define MQTTSN_TOPIC_PREDEFINED 0x01
+
+struct MqttSnTopic {
+  char name[SENSORA_MAX_TOPIC_LEN];
+  uint16_t id;
+  bool predefined;
+};
+
+struct MqttSnMessage {
+  char topic[SENSORA_MAX_TOPIC_LEN];
+  uint8_t payload[SENSORA_MQTTSN_PACKET_SIZE];
+  size_t len;
+};
+
+// MQTT-SN v1.2 client over UDP. Topic names are registered once per
+// connection and every publish afterwards only carries the 2-byte topic id.
+// Requests wait for their acknowledgement by reading the socket, so replies
+// to the gateway go out from their own buffer and inbound publishes are
+// queued and delivered from poll(), never while a request is outstanding.
+template <typename TUdp>
+class MqttSnTransport {
+ public:
+  MqttSnTransport(TUdp& udp)
+      : udp(udp), isConnected(false), msgId(0), topicCount(0), callback(nullptr), rxHead(0), rxCount(0), rxLen(0), rxPos(0), lastTx(0), lastRx(0) {
+  }
+
+  void setup() {
+    SENSORA_LOGD("setup Sensora MQTT-SN transport");
+    udp.begin(SENSORA_MQTTSN_LOCAL_PORT);
+    for (uint8_t i = 0; i < topicCount; i++) {
+      if (!topics[i].predefined) {
+        topics[i].id = 0;
+      }
+    }
+  }
+
+  // the gateway must map the same id, used for QoS -1 publishes
+  bool predefine(const char* topic, uint16_t id) {
+    MqttSnTopic* t = findTopic(topic);
+    if (t == nullptr) {
+      t = addTopic(topic);
+    }
+    if (t == nullptr) {
+      return false;
+    }
+    t->id = id;
+    t->predefined = true;
+    return true;
+  }
+
+  bool connect() {
+    if (isConnected) {
+      return true;
+    }
+    SENSORA_LOGD("connecting to Sensora MQTT-SN gateway");
+    size_t idLen = strlen(deviceConfig.deviceId);
+    uint8_t* p = beginPacket(MqttSnMsg::Connect, 4 + idLen);
+    *p++ = MQTTSN_FLAG_WILL | (SENSORA_MQTT_CLEAN_SESSION ? MQTTSN_FLAG_CLEAN : 0);
+    *p++ = 0x01;
+    *p++ = MQTTSN_KEEP_ALIVE_S >> 8;
+    *p++ = MQTTSN_KEEP_ALIVE_S & 0xFF;
+    memcpy(p, deviceConfig.deviceId, idLen);
+    if (!request(MqttSnMsg::ConnAck, 0) || ackRc != 0) {
+      SENSORA_LOGE("failed to connect to Sensora MQTT-SN gateway, code %d", ackRc);
+      return false;
+    }
+    SENSORA_LOGI("connected to Sensora MQTT-SN gateway");
+    isConnected = true;
+    lastRx = millis();
+    return true;
+  }
+
+  bool publish(const char* topic, const uint8_t* buf, unsigned long size) {
+    if (size == 0) {
+      SENSORA_LOGW("cannot publish mqtt paylod with size 0");
+      return false;
+    }
+    MqttSnTopic* t = registerTopic(topic);
+    if (t == nullptr) {
+      SENSORA_LOGE("failed to register topic '%s'", topic);
+      return false;
+    }
+    if (size > SENSORA_MQTTSN_PACKET_SIZE - 7) {
+      SENSORA_LOGE("mqtt-sn payload too large, size %lu", size);
+      return false;
+    }
+    SENSORA_LOGD("publish to topic '%s' id %u", topic, t->id);
+    uint8_t flags = t->predefined ? MQTTSN_TOPIC_PREDEFINED : MQTTSN_TOPIC_NORMAL;
+    uint16_t id = 0;
+    if (SENSORA_MQTTSN_QOS < 0 && t->predefined) {
+      flags |= MQTTSN_FLAG_QOS_M1;
+    } else if (SENSORA_MQTTSN_QOS > 0) {
+      flags |= MQTTSN_FLAG_QOS_1;
+      id = nextMsgId();
+    }
+    uint8_t* p = beginPacket(MqttSnMsg::Publish, 5 + size);
+    *p++ = flags;
+    p = writeUint16(p, t->id);
+    p = writeUint16(p, id);
+    memcpy(p, buf, size);
+    if (id == 0) {
+      return sendPacket(txBuf, txLen);
+    }
+    return request(MqttSnMsg::PubAck, id) && ackRc == 0;
+  }
+
+  int subscribe(const char* topic) {
+    size_t nameLen = strlen(topic);
+    uint16_t id = nextMsgId();
+    uint8_t* p = beginPacket(MqttSnMsg::Subscribe, 3 + nameLen);
+    *p++ = MQTTSN_FLAG_QOS_1 | MQTTSN_TOPIC_NORMAL;
+    p = writeUint16(p, id);
+    memcpy(p, topic, nameLen);
+    if (!request(MqttSnMsg::SubAck, id) || ackRc != 0) {
+      return 0;
+    }
+    // wildcard subscriptions get topic id 0, the gateway registers each topic later
+    if (ackTopicId != 0) {
+      MqttSnTopic* t = findTopic(topic);
+      if (t == nullptr) {
+        t = addTopic(topic);
+      }
+      if (t != nullptr) {
+        t->id = ackTopicId;
+      }
+    }
+    return 1;
+  }
+
+  void poll() {
+    do {
+      deliver();
+    } while (receive());
+    unsigned long now = millis();
+    if (!isConnected) {
+      return;
+    }
+    if (now - lastRx >= MQTTSN_KEEP_ALIVE_S * 1500UL) {
+      SENSORA_LOGW("mqtt-sn gateway keep alive timeout");
+      isConnected = false;
+      return;
+    }
+    if (now - lastTx >= MQTTSN_KEEP_ALIVE_S * 1000UL) {
+      beginPacket(MqttSnMsg::PingReq, 0);
+      sendPacket(txBuf, txLen);
+    }
+  }
+
+  void stop() {
+    if (isConnected) {
+      beginPacket(MqttSnMsg::Disconnect, 0);
+      sendPacket(txBuf, txLen);
+    }
+    isConnected = false;
+  }
+
+  void onMessage(void (*cb)(int)) { callback = cb; }
+  const char* messageTopic() { return rxTopic; }
+
+  int read() {
+    if (rxPos >= rxLen) {
+      return -1;
+    }
+    return rxBuf[rxPos++];
+  }
+
+  bool connected() { return isConnected; }
+  bool sessionPresent() const { return false; }
+  unsigned long handshakeMs() const { return 0; }
+
+ private:
+  TUdp& udp;
+  bool isConnected;
+  uint16_t msgId;
+  MqttSnTopic topics[SENSORA_MQTTSN_MAX_TOPICS];
+  uint8_t topicCount;
+  void (*callback)(int);
+
+  // txBuf holds the outstanding request until it is acknowledged, replies
+  // to the gateway are built in replyBuf
+  uint8_t txBuf[SENSORA_MQTTSN_PACKET_SIZE];
+  size_t txLen;
+  uint8_t replyBuf[SENSORA_MQTTSN_PACKET_SIZE];
+  size_t replyLen;
+  uint8_t pkt[SENSORA_MQTTSN_PACKET_SIZE];
+  MqttSnMessage rxQueue[SENSORA_MQTTSN_RX_QUEUE_SIZE];
+  uint8_t rxHead;
+  uint8_t rxCount;
+  uint8_t rxBuf[SENSORA_MQTTSN_PACKET_SIZE];
+  char rxTopic[SENSORA_MAX_TOPIC_LEN];
+  size_t rxLen;
+  size_t rxPos;
+  unsigned long lastTx;
+  unsigned long lastRx;
+
+  uint16_t ackTopicId;
+  uint16_t ackMsgId;
+  uint8_t ackRc;
+
+  uint16_t nextMsgId() {
+    if (++msgId == 0) {
+      msgId = 1;
+    }
+    return msgId;
+  }
+
+  static uint8_t* writeUint16(uint8_t* p, uint16_t v) {
+    *p++ = v >> 8;
+    *p++ = v & 0xFF;
+    return p;
+  }
+
+  static uint16_t readUint16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+  }
+
+  uint8_t* beginPacket(MqttSnMsg type, size_t bodyLen) {
+    txLen = bodyLen + 2;
+    txBuf[0] = txLen;
+    txBuf[1] = static_cast<uint8_t>(type);
+    return txBuf + 2;
+  }
+
+  uint8_t* beginReply(MqttSnMsg type, size_t bodyLen) {
+    replyLen = bodyLen + 2;
+    replyBuf[0] = replyLen;
+    replyBuf[1] = static_cast<uint8_t>(type);
+    return replyBuf + 2;
+  }
+
+  bool sendPacket(const uint8_t* buf, size_t len) {
+    if (!udp.beginPacket(SENSORA_MQTTSN_HOST, SENSORA_MQTTSN_PORT)) {
+      return false;
+    }
+    udp.write(buf, len);
+    lastTx = millis();
+    return udp.endPacket();
+  }
+
+  // sends the packet in txBuf and waits for the matching acknowledgement,
+  // retransmitting with the DUP flag where the message type has one
+  bool request(MqttSnMsg ack, uint16_t id) {
+    for (uint8_t attempt = 0; attempt < MQTTSN_RETRIES; attempt++) {
+      if (attempt > 0 && (txBuf[1] == static_cast<uint8_t>(MqttSnMsg::Publish) || txBuf[1] == static_cast<uint8_t>(MqttSnMsg::Subscribe))) {
+        txBuf[2] |= MQTTSN_FLAG_DUP;
+      }
+      if (!sendPacket(txBuf, txLen)) {
+        continue;
+      }
+      unsigned long start = millis();
+      while (millis() - start < MQTTSN_RETRY_TIMEOUT_MS) {
+        int type = receive();
+        if (type == static_cast<int>(ack) && (id == 0 || ackMsgId == id)) {
+          return true;
+        }
+        if (type == 0) {
+          yield();
+        }
+      }
+    }
+    return false;
+  }
+
+  MqttSnTopic* findTopic(const char* name) {
+    for (uint8_t i = 0; i < topicCount; i++) {
+      if (strcmp(topics[i].name, name) == 0) {
+        return &topics[i];
+      }
+    }
+    return nullptr;
+  }
+
+  MqttSnTopic* findTopic(uint16_t id) {
+    for (uint8_t i = 0; i < topicCount; i++) {
+      if (topics[i].id == id) {
+        return &topics[i];
+      }
+    }
+    return nullptr;
+  }
+
+  MqttSnTopic* addTopic(const char* name) {
+    if (topicCount >= SENSORA_MQTTSN_MAX_TOPICS) {
+      SENSORA_LOGE("Maximum mqtt-sn topics reached. Please change SENSORA_MQTTSN_MAX_TOPICS");
+      return nullptr;
+    }
+    MqttSnTopic* t = &topics[topicCount++];
+    copyString(name, t->name);
+    t->id = 0;
+    t->predefined = false;
+    return t;
+  }
+
+  MqttSnTopic* registerTopic(const char* name) {
+    MqttSnTopic* t = findTopic(name);
+    if (t == nullptr) {
+      t = addTopic(name);
+    }
+    if (t == nullptr || t->id != 0) {
+      return t;
+    }
+    size_t nameLen = strlen(name);
+    uint16_t id = nextMsgId();
+    uint8_t* p = beginPacket(MqttSnMsg::Register, 4 + nameLen);
+    p = writeUint16(p, 0);
+    p = writeUint16(p, id);
+    memcpy(p, name, nameLen);
+    if (!request(MqttSnMsg::RegAck, id) || ackRc != 0) {
+      return nullptr;
+    }
+    t->id = ackTopicId;
+    return t;
+  }
+
+  void sendWill(MqttSnMsg type) {
+    char topic[45];
+    snprintf(topic, sizeof(topic), "sc/%s/dev/info", deviceConfig.deviceId);
+    SensoraPayload p;
+    p.add("status", static_cast<uint8_t>(DeviceStatus::Lost));
+    if (type == MqttSnMsg::WillTopic) {
+      size_t len = strlen(topic);
+      uint8_t* b = beginReply(type, 1 + len);
+      *b++ = MQTTSN_FLAG_QOS_1 | MQTTSN_FLAG_RETAIN;
+      memcpy(b, topic, len);
+    } else {
+      memcpy(beginReply(type, p.length()), p.buffer(), p.length());
+    }
+    sendPacket(replyBuf, replyLen);
+  }
+
+  // reads and handles one datagram, returns its message type or 0
+  int receive() {
+    int size = udp.parsePacket();
+    if (size <= 0) {
+      return 0;
+    }
+    if (size > SENSORA_MQTTSN_PACKET_SIZE) {
+      udp.flush();
+      return 0;
+    }
+    size_t len = udp.read(pkt, size);
+    size_t hdr = 2;
+    size_t pktLen = pkt[0];
+    if (pkt[0] == 0x01 && len >= 4) {
+      hdr = 4;
+      pktLen = readUint16(pkt + 1);
+    }
+    if (pktLen != len || len < hdr) {
+      return 0;
+    }
+    lastRx = millis();
+    MqttSnMsg type = static_cast<MqttSnMsg>(pkt[hdr - 1]);
+    const uint8_t* body = pkt + hdr;
+    size_t bodyLen = len - hdr;
+
+    switch (type) {
+      case MqttSnMsg::ConnAck:
+        ackRc = bodyLen >= 1 ? body[0] : 0xFF;
+        break;
+      case MqttSnMsg::WillTopicReq:
+      case MqttSnMsg::WillMsgReq:
+        sendWill(type == MqttSnMsg::WillTopicReq ? MqttSnMsg::WillTopic : MqttSnMsg::WillMsg);
+        break;
+      case MqttSnMsg::RegAck:
+      case MqttSnMsg::PubAck:
+        if (bodyLen >= 5) {
+          ackTopicId = readUint16(body);
+          ackMsgId = readUint16(body + 2);
+          ackRc = body[4];
+        }
+        break;
+      case MqttSnMsg::SubAck:
+        if (bodyLen >= 6) {
+          ackTopicId = readUint16(body + 1);
+          ackMsgId = readUint16(body + 3);
+          ackRc = body[5];
+        }
+        break;
+      case MqttSnMsg::Register:
+        handleRegister(body, bodyLen);
+        break;
+      case MqttSnMsg::Publish:
+        handlePublish(body, bodyLen);
+        break;
+      case MqttSnMsg::Disconnect:
+        SENSORA_LOGW("mqtt-sn gateway closed the connection");
+        isConnected = false;
+        break;
+      default:
+        break;
+    }
+    return static_cast<int>(type);
+  }
+
+  void handleRegister(const uint8_t* body, size_t len) {
+    if (len < 5) {
+      return;
+    }
+    uint16_t topicId = readUint16(body);
+    uint16_t id = readUint16(body + 2);
+    char name[SENSORA_MAX_TOPIC_LEN];
+    size_t nameLen = len - 4 < sizeof(name) - 1 ? len - 4 : sizeof(name) - 1;
+    memcpy(name, body + 4, nameLen);
+    name[nameLen] = '\0';
+    MqttSnTopic* t = findTopic(name);
+    if (t == nullptr) {
+      t = addTopic(name);
+    }
+    uint8_t rc = 0x00;
+    if (t == nullptr) {
+      rc = 0x02;
+    } else {
+      t->id = topicId;
+    }
+    uint8_t* p = beginReply(MqttSnMsg::RegAck, 5);
+    p = writeUint16(p, topicId);
+    p = writeUint16(p, id);
+    *p = rc;
+    sendPacket(replyBuf, replyLen);
+  }
+
+  void handlePublish(const uint8_t* body, size_t len) {
+    if (len < 5) {
+      return;
+    }
+    uint8_t flags = body[0];
+    uint16_t topicId = readUint16(body + 1);
+    uint16_t id = readUint16(body + 3);
+    MqttSnTopic* t = findTopic(topicId);
+    // 0x01 (congestion) makes the gateway retry a QoS 1 publish later
+    uint8_t rc = 0x00;
+    if (t == nullptr) {
+      SENSORA_LOGW("mqtt-sn publish for unknown topic id %u", topicId);
+      rc = 0x02;
+    } else if (rxCount >= SENSORA_MQTTSN_RX_QUEUE_SIZE) {
+      SENSORA_LOGW("mqtt-sn receive queue full, dropped publish on '%s'", t->name);
+      rc = 0x01;
+    } else {
+      MqttSnMessage& m = rxQueue[(rxHead + rxCount) % SENSORA_MQTTSN_RX_QUEUE_SIZE];
+      copyString(t->name, m.topic);
+      m.len = len - 5;
+      memcpy(m.payload, body + 5, m.len);
+      rxCount++;
+    }
+    if ((flags & MQTTSN_FLAG_QOS_M1) == MQTTSN_FLAG_QOS_1) {
+      uint8_t* p = beginReply(MqttSnMsg::PubAck, 5);
+      p = writeUint16(p, topicId);
+      p = writeUint16(p, id);
+      *p = rc;
+      sendPacket(replyBuf, replyLen);
+    }
+  }
+
+  // the callback may publish, which queues anything received meanwhile
+  void deliver() {
+    while (rxCount > 0) {
+      MqttSnMessage& m = rxQueue[rxHead];
+      copyString(m.topic, rxTopic);
+      memcpy(rxBuf, m.payload, m.len);
+      rxLen = m.len;
+      rxPos = 0;
+      rxHead = (rxHead + 1) % SENSORA_MQTTSN_RX_QUEUE_SIZE;
+      rxCount--;
+      if (callback != nullptr) {
+        callback(rxLen);
+      }
+    }
+  }
+};
+
+#endif
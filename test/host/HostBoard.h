@@ -0,0 +1,143 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HostBoard_h
+#define HostBoard_h
+
+#include <Transport/LoopbackTransport.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef SENSORA_DUAL_CORE
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#endif
+
+// config records written through the board, kept across device instances
+inline std::map<std::string, std::vector<uint8_t>> hostStore;
+inline bool hostWoke = false;
+inline unsigned long hostSleptFor = 0;
+
+#ifdef SENSORA_DUAL_CORE
+// The sync task runs on hostSyncThread. Each step holds hostNetLock, which
+// stands in for the network stack: take it before touching the transport
+// from the test.
+inline std::mutex hostNetLock;
+inline std::thread hostSyncThread;
+inline std::atomic<bool> hostSyncStop(false);
+
+inline void stopSyncTask() {
+  hostSyncStop = true;
+  if (hostSyncThread.joinable()) {
+    hostSyncThread.join();
+  }
+}
+#endif
+
+// Board with an always connected network and config kept in hostStore. The
+// device owns its board, so tests steer it through the globals above.
+class HostBoard {
+ public:
+  void setup() {}
+  void loop() {}
+  bool isProvision() { return false; }
+  template <typename T>
+  void setupProvision(T&) {}
+  void loopProvision() {}
+
+  void connectNetwork() {}
+  bool isNetworkConnected() { return true; }
+  unsigned long networkConnTimeout() { return 10000; }
+  void onNetworkConnected() {}
+
+  void readInfo(SensoraPayload& payload) { payload.add("ip", "127.0.0.1"); }
+  void readStats(SensoraPayload& payload) { payload.add("rssi", static_cast<int8_t>(-40)); }
+
+  bool wokeFromSleep() { return hostWoke; }
+  void deepSleep(unsigned long seconds) { hostSleptFor = seconds; }
+#ifdef SENSORA_DUAL_CORE
+  bool startSyncTask(void (*step)(void*), void* arg) {
+    hostSyncStop = false;
+    hostSyncThread = std::thread([step, arg]() {
+      while (!hostSyncStop) {
+        {
+          std::lock_guard<std::mutex> lock(hostNetLock);
+          step(arg);
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+      }
+    });
+    return true;
+  }
+#else
+  bool startSyncTask(void (*)(void*), void*) { return false; }
+#endif
+
+  template <typename T>
+  bool readConfig(const char* key, T& config) {
+    auto it = hostStore.find(key);
+    if (it == hostStore.end() || it->second.size() != sizeof(T)) {
+      return false;
+    }
+    memcpy(&config, it->second.data(), sizeof(T));
+    return true;
+  }
+
+  template <typename T>
+  void writeConfig(const char* key, const T& config) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&config);
+    hostStore[key].assign(p, p + sizeof(T));
+  }
+};
+
+// Every device test runs a single device over LoopbackTransport.
+typedef SensoraDevice<HostBoard, LoopbackTransport> Device;
+
+inline LoopbackTransport loopback;
+inline Device device(loopback);
+
+template <>
+inline void Device::onMessage(int len) {
+  device.handleMessage(len);
+}
+
+// moves the clock stepMs ahead of each loop()
+inline void run(int loops, unsigned long stepMs = 10) {
+  for (int i = 0; i < loops; i++) {
+    hostNow += stepMs;
+    device.loop();
+  }
+}
+
+// false if the loopback inbound queue is full
+inline bool deliver(const char* topic, const char* payload) {
+#ifdef SENSORA_DUAL_CORE
+  std::lock_guard<std::mutex> lock(hostNetLock);
+#endif
+  return loopback.deliver(topic, reinterpret_cast<const uint8_t*>(payload), strlen(payload));
+}
+
+// runs setup() and enough loops to connect and sync device and property info
+inline void startDevice() {
+  device.setup();
+  run(20);
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HostTest_h
+#define HostTest_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+inline int hostFailures = 0;
+
+#define CHECK(cond)                                                 \
+  do {                                                              \
+    if (!(cond)) {                                                  \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      hostFailures++;                                               \
+    }                                                               \
+  } while (0)
+
+#define RUN(test)                 \
+  do {                            \
+    int before = hostFailures;    \
+    test();                       \
+    printf("%s %s\n", hostFailures == before ? "ok  " : "FAIL", #test); \
+  } while (0)
+
+// true if one of the last messages sent through a LoopbackTransport went to
+// a topic containing topicPart with a payload starting with payloadPrefix
+template <typename TLoopback>
+bool sentMessage(const TLoopback& transport, const char* topicPart, const char* payloadPrefix) {
+  size_t prefixLen = strlen(payloadPrefix);
+  for (unsigned long i = 0; transport.sent(i) != nullptr; i++) {
+    auto m = transport.sent(i);
+    if (strstr(m->topic, topicPart) != nullptr && m->len >= prefixLen && memcmp(m->payload, payloadPrefix, prefixLen) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline int hostResult() {
+  return hostFailures == 0 ? 0 : 1;
+}
+
+#endif
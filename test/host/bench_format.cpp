@@ -0,0 +1,69 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Formatting and parsing kernels against the printf and strtod calls they
+// replace.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include <chrono>
+#include <random>
+
+static const int count = 4096;
+static float floats[count];
+static int32_t ints[count];
+static char texts[count][16];
+static volatile size_t sink;
+
+template <typename F>
+static double nsPerCall(F f) {
+  const int rounds = 200;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < count; i++) {
+      f(i);
+    }
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (rounds * count);
+}
+
+static void report(const char* name, double ours, double libc) {
+  printf("%-12s %7.1f ns  libc %7.1f ns  %.1fx\n", name, ours, libc, libc / ours);
+}
+
+int main() {
+  std::mt19937 rng(1);
+  std::normal_distribution<float> sensor(20, 15);
+  for (int i = 0; i < count; i++) {
+    floats[i] = roundf(sensor(rng) * 100) / 100;
+    ints[i] = static_cast<int32_t>(rng());
+    snprintf(texts[i], sizeof(texts[i]), "%.2f", floats[i]);
+  }
+  char out[64];
+
+  report("formatInt", nsPerCall([&](int i) { sink += formatInt(ints[i], out); }),
+         nsPerCall([&](int i) { sink += snprintf(out, sizeof(out), "%ld", static_cast<long>(ints[i])); }));
+  report("formatFixed", nsPerCall([&](int i) { sink += formatFixed(floats[i], 3, out, sizeof(out)); }),
+         nsPerCall([&](int i) { sink += snprintf(out, sizeof(out), "%.3f", floats[i]); }));
+  report("formatFloat", nsPerCall([&](int i) { sink += formatFloat(floats[i], out); }),
+         nsPerCall([&](int i) { sink += snprintf(out, sizeof(out), "%.9g", floats[i]); }));
+  report("parseFloat", nsPerCall([&](int i) { sink += parseFloat(texts[i]) > 0; }),
+         nsPerCall([&](int i) { sink += strtod(texts[i], nullptr) > 0; }));
+  report("parseInt", nsPerCall([&](int i) { sink += parseInt(texts[i]); }),
+         nsPerCall([&](int i) { sink += atoi(texts[i]); }));
+  return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Encode and decode speed of history batches and the size of a typical
+// sensor series against raw 8 byte points.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <SensoraHistory.h>
+
+#include <chrono>
+#include <random>
+
+static const int pointCount = 900;
+static uint32_t times[pointCount];
+static float values[pointCount];
+static uint8_t storage[16384];
+
+static double nsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  std::mt19937 rng(1);
+  std::normal_distribution<float> jitter(0, 3);
+  uint32_t t = 123456;
+  float v = 21.5f;
+  for (int i = 0; i < pointCount; i++) {
+    t += 1000 + static_cast<int>(jitter(rng));
+    if (i % 10 == 0) {
+      v = roundf((v + jitter(rng) * 0.01f) * 100) / 100;
+    }
+    times[i] = t;
+    values[i] = v;
+  }
+
+  HistoryEncoder encoder;
+  encoder.begin(storage, sizeof(storage), "temperature");
+  const int rounds = 2000;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    encoder.reset();
+    for (int i = 0; i < pointCount; i++) {
+      encoder.add(times[i], values[i]);
+    }
+  }
+  double encodeNs = nsSince(start) / (rounds * pointCount);
+  size_t len = encoder.seal(t);
+
+  volatile float sink = 0;
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    HistoryDecoder decoder(encoder.data(), len);
+    uint32_t dt;
+    float dv;
+    while (decoder.next(dt, dv)) {
+      sink = sink + dv;
+    }
+  }
+  double decodeNs = nsSince(start) / (rounds * pointCount);
+
+  printf("history: %d points in %zu bytes (%.1fx vs raw), encode %.1f ns/point, decode %.1f ns/point\n", pointCount, len,
+         pointCount * 8.0 / len, encodeNs, decodeNs);
+  return 0;
+}
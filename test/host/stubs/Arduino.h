@@ -0,0 +1,148 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host stand-in for the parts of the Arduino core the library uses. Time
+// only moves when a test advances hostNow or the code under test waits in
+// delay() or yield().
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <string>
+
+typedef uint8_t byte;
+
+// atomic so the dual-core tests can read it from the sync thread
+inline std::atomic<unsigned long> hostNow(1);
+
+inline unsigned long millis() { return hostNow; }
+inline unsigned long micros() { return hostNow * 1000UL; }
+inline void delay(unsigned long ms) { hostNow += ms; }
+inline void yield() { hostNow++; }
+inline long random(long lo, long hi) { return lo + rand() % (hi - lo); }
+
+class __FlashStringHelper;
+#define F(s) reinterpret_cast<const __FlashStringHelper*>(s)
+#define vsnprintf_P vsnprintf
+
+class String {
+ public:
+  String() {}
+  String(const char* s) : s(s) {}
+  const char* c_str() const { return s.c_str(); }
+  unsigned int length() const { return s.size(); }
+
+ private:
+  std::string s;
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      write(buf[i]);
+    }
+    return size;
+  }
+  size_t write(const char* buf, size_t size) { return write(reinterpret_cast<const uint8_t*>(buf), size); }
+  size_t print(const char* s) { return write(s, strlen(s)); }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+// log output goes to stderr, set hostQuiet to silence it
+inline bool hostQuiet = true;
+
+class HardwareSerial : public Stream {
+ public:
+  void begin(long) {}
+  size_t write(uint8_t b) {
+    if (!hostQuiet) {
+      fputc(b, stderr);
+    }
+    return 1;
+  }
+  using Print::write;
+  int available() { return 0; }
+  int read() { return -1; }
+  int peek() { return -1; }
+};
+
+inline HardwareSerial Serial;
+
+class IPAddress {
+ public:
+  IPAddress() : addr(0) {}
+  IPAddress(uint32_t a) : addr(a) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr(a | (b << 8) | (c << 16) | (static_cast<uint32_t>(d) << 24)) {}
+  operator uint32_t() const { return addr; }
+  uint8_t operator[](int i) const { return (addr >> (8 * i)) & 0xFF; }
+
+ private:
+  uint32_t addr;
+};
+
+class Client : public Stream {
+ public:
+  virtual int connect(IPAddress ip, uint16_t port) = 0;
+  virtual int connect(const char* host, uint16_t port) = 0;
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size) = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int read(uint8_t* buf, size_t size) = 0;
+  virtual int peek() = 0;
+  virtual void flush() = 0;
+  virtual void stop() = 0;
+  virtual uint8_t connected() = 0;
+  virtual operator bool() = 0;
+};
+
+class UDP : public Stream {
+ public:
+  virtual uint8_t begin(uint16_t) = 0;
+  virtual void stop() = 0;
+  virtual int beginPacket(IPAddress ip, uint16_t port) = 0;
+  virtual int beginPacket(const char* host, uint16_t port) = 0;
+  virtual int endPacket() = 0;
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size) = 0;
+  virtual int parsePacket() = 0;
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int read(unsigned char* buf, size_t len) = 0;
+  virtual int read(char* buf, size_t len) = 0;
+  virtual int peek() = 0;
+  virtual void flush() = 0;
+  virtual IPAddress remoteIP() = 0;
+  virtual uint16_t remotePort() = 0;
+};
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host stand-in for ArduinoMqttClient, only enough to compile
+// SensoraTransport. Host tests run the device over LoopbackTransport.
+
+#ifndef ArduinoMqttClient_h
+#define ArduinoMqttClient_h
+
+#include <Arduino.h>
+
+class MqttClient {
+ public:
+  MqttClient(Client&) {}
+
+  void setId(const char*) {}
+  void setUsernamePassword(const char*, const char*) {}
+  void setKeepAliveInterval(unsigned long) {}
+  void setCleanSession(bool) {}
+  int beginWill(const char*, bool, uint8_t) { return 1; }
+  int endWill() { return 1; }
+  int connect(const char*, uint16_t) { return 0; }
+  int connectError() const { return -1; }
+  int connected() { return 0; }
+  int beginMessage(const char*, unsigned long, bool, uint8_t) { return 0; }
+  size_t write(const uint8_t*, size_t) { return 0; }
+  int endMessage() { return 0; }
+  int subscribe(const char*, uint8_t) { return 0; }
+  void onMessage(void (*)(int)) {}
+  void poll() {}
+  int read() { return -1; }
+  void stop() {}
+  String messageTopic() const { return String(); }
+};
+
+#endif
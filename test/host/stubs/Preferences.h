@@ -0,0 +1,53 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host stand-in for the ESP32 Preferences library, one in-memory namespace
+// that counts writes so tests can see when a record reaches flash.
+
+#ifndef Preferences_h
+#define Preferences_h
+
+#include <map>
+#include <string>
+#include <vector>
+
+class Preferences {
+ public:
+  std::map<std::string, std::vector<uint8_t>> store;
+  unsigned long puts = 0;
+
+  bool begin(const char*, bool) { return true; }
+  void end() {}
+
+  size_t getBytes(const char* key, void* buf, size_t len) {
+    auto it = store.find(key);
+    if (it == store.end()) {
+      return 0;
+    }
+    size_t n = it->second.size() < len ? it->second.size() : len;
+    memcpy(buf, it->second.data(), n);
+    return n;
+  }
+
+  size_t putBytes(const char* key, const void* buf, size_t len) {
+    const uint8_t* b = static_cast<const uint8_t*>(buf);
+    store[key].assign(b, b + len);
+    puts++;
+    return len;
+  }
+};
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Counts heap allocations while a connected device publishes, escapes and
+// applies inbound writes. The steady state must not allocate at all.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include <new>
+
+#include "HostBoard.h"
+#include "HostTest.h"
+
+// glibc's own entry points, so malloc can be replaced without linker flags
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* p, size_t size);
+
+static unsigned long allocations = 0;
+
+extern "C" void* malloc(size_t size) {
+  allocations++;
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+  allocations++;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* p, size_t size) {
+  allocations++;
+  return __libc_realloc(p, size);
+}
+
+// the replacements below pair new with malloc and delete with free
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t size) {
+  void* p = malloc(size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+  free(p);
+}
+
+#pragma GCC diagnostic pop
+
+Property temperature("temp");
+Property note("note");
+Property led("led");
+
+void countsAllocations() {
+  unsigned long before = allocations;
+  void* p = malloc(16);
+  free(p);
+  delete new int(1);
+  CHECK(allocations == before + 2);
+}
+
+void steadyStateDoesNotAllocate() {
+  startDevice();
+  CHECK(loopback.connected());
+  unsigned long sent = loopback.sentCount();
+  unsigned long before = allocations;
+  for (int i = 0; i < 10000; i++) {
+    temperature.setValue(20.0f + i * 0.01f);
+    // ';' in a value is escaped while the payload is built
+    note.setValue(i % 2 ? "alarm;zone=kitchen;level=2" : "alarm;zone=garage;level=1");
+    const char* write = i % 2 ? "id=led;value=true" : "id=led;value=false";
+    deliver("sc/dev/msg/recv", write);
+    run(1, 1000);
+  }
+  run(1);
+  unsigned long counted = allocations - before;
+  CHECK(counted == 0);
+  if (counted != 0) {
+    fprintf(stderr, "%lu allocations in 10000 steps\n", counted);
+  }
+  CHECK(loopback.sentCount() - sent >= 10000);
+  CHECK(sentMessage(loopback, "sc/dev/msg/pub", "id=note;value=alarm\\;zone="));
+  CHECK(led.Bool());
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  temperature.setDataType(DataType::Float);
+  led.setDataType(DataType::Boolean).setAccessMode(AccessMode::ReadWrite);
+  RUN(countsAllocations);
+  RUN(steadyStateDoesNotAllocate);
+  return hostResult();
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Multi-property writes on sc/<id>/msg/batch: applied together or not at
+// all, and acked on sc/<id>/msg/ack.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include <string>
+
+#include "HostBoard.h"
+#include "HostTest.h"
+
+Property mode("mode");
+Property level("level");
+Property color("color");
+Property temp("temp");
+
+int batches = 0;
+uint8_t lastCount = 0;
+int levelWrites = 0;
+
+void onBatch(Property** props, uint8_t count) {
+  batches++;
+  lastCount = count;
+}
+
+void onLevel(PropertyValue& value) {
+  levelWrites++;
+}
+
+static void batch(const char* payload) {
+  deliver("sc/dev/msg/batch", payload);
+  run(3);
+}
+
+// the values of every test below must stay as this one left them
+static bool unchanged() {
+  return strcmp(mode.getBuff(), "eco") == 0 && level.Int() == 3 && strcmp(color.getBuff(), "#00ff00") == 0;
+}
+
+void appliesValidBatch() {
+  startDevice();
+  CHECK(loopback.isSubscribed("sc/dev/msg/batch"));
+  batch("batch=b1;mode=eco;level=3;color=#00ff00");
+  CHECK(batches == 1);
+  CHECK(lastCount == 3);
+  CHECK(levelWrites == 0);
+  CHECK(unchanged());
+  CHECK(sentMessage(loopback, "sc/dev/msg/ack", "batch=b1;accepted=3"));
+}
+
+void rejectsUnknownProperty() {
+  batch("batch=b2;mode=boost;level=9;missing=1");
+  CHECK(sentMessage(loopback, "sc/dev/msg/ack", "batch=b2;accepted=0;error=unknown_property"));
+  CHECK(batches == 1);
+  CHECK(unchanged());
+}
+
+void rejectsReadOnlyProperty() {
+  batch("batch=b3;mode=boost;temp=20");
+  CHECK(sentMessage(loopback, "sc/dev/msg/ack", "batch=b3;accepted=0;error=read_only"));
+  CHECK(batches == 1);
+  CHECK(unchanged());
+}
+
+void rejectsInvalidValue() {
+  batch("batch=b4;mode=boost;color=#00ff0");
+  CHECK(sentMessage(loopback, "sc/dev/msg/ack", "batch=b4;accepted=0;error=invalid_value"));
+  CHECK(batches == 1);
+  CHECK(unchanged());
+}
+
+// more writes than the inbox can take at once
+void rejectsBatchLargerThanInbox() {
+  std::string payload = "batch=b5";
+  for (int i = 0; i <= DEVICE_INBOX_SIZE; i++) {
+    payload += ";level=" + std::to_string(10 + i);
+  }
+  batch(payload.c_str());
+  CHECK(sentMessage(loopback, "sc/dev/msg/ack", "batch=b5;accepted=0;error=inbox_full"));
+  CHECK(batches == 1);
+  CHECK(unchanged());
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  mode.setAccessMode(AccessMode::ReadWrite);
+  level.setDataType(DataType::Integer).setAccessMode(AccessMode::Write).subscribe(onLevel);
+  color.setDataType(DataType::Color).setAccessMode(AccessMode::Write);
+  temp.setDataType(DataType::Integer);
+  device.onBatch(onBatch);
+  RUN(appliesValidBatch);
+  RUN(rejectsUnknownProperty);
+  RUN(rejectsReadOnlyProperty);
+  RUN(rejectsInvalidValue);
+  RUN(rejectsBatchLargerThanInbox);
+  return hostResult();
+}
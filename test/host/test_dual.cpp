@@ -0,0 +1,152 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Built with SENSORA_DUAL_CORE: runSync() runs on the board's sync thread
+// while this thread calls setValue() and loop(), and a third thread plays
+// the cloud sending single and batch writes.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "HostBoard.h"
+#include "HostTest.h"
+
+#define STRESS_WRITES 3000
+#define STRESS_SETS 20000
+
+Property counter("counter");
+Property target("target");
+Property a("a");
+Property b("b");
+
+std::atomic<int> targetWrites(0);
+std::atomic<int> targetBackwards(0);
+std::atomic<int> lastTarget(0);
+std::atomic<int> batches(0);
+std::atomic<int> tornBatches(0);
+
+void onTarget(PropertyValue& value) {
+  int v = value.Int();
+  if (v < lastTarget) {
+    targetBackwards++;
+  }
+  lastTarget = v;
+  targetWrites++;
+}
+
+void onAb(Property** props, uint8_t count) {
+  if (count != 2 || props[0]->Int() != props[1]->Int()) {
+    tornBatches++;
+  }
+  batches++;
+}
+
+void pause() {
+  std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+bool sent(const char* topicPart, const char* payloadPrefix) {
+  std::lock_guard<std::mutex> lock(hostNetLock);
+  return sentMessage(loopback, topicPart, payloadPrefix);
+}
+
+// runs the application side until cond holds or about a second has passed
+template <typename Cond>
+bool runUntil(Cond cond) {
+  for (int i = 0; i < 10000; i++) {
+    if (cond()) {
+      return true;
+    }
+    run(1);
+    pause();
+  }
+  return cond();
+}
+
+void deliverRetrying(const char* topic, const char* payload) {
+  while (!deliver(topic, payload)) {
+    std::this_thread::yield();
+  }
+}
+
+void connectsFromSyncThread() {
+  device.setup();
+  CHECK(runUntil([] {
+    std::lock_guard<std::mutex> lock(hostNetLock);
+    return loopback.isSubscribed("sc/dev/msg/batch");
+  }));
+  CHECK(runUntil([] { return sent("sc/dev/dev/info", ""); }));
+}
+
+void survivesConcurrentWritesAndSets() {
+  std::atomic<bool> cloudDone(false);
+  std::thread cloud([&cloudDone] {
+    char payload[64];
+    for (int k = 1; k <= STRESS_WRITES; k++) {
+      snprintf(payload, sizeof(payload), "id=target;value=%d", k);
+      deliverRetrying("sc/dev/msg/recv", payload);
+      if (k % 4 == 0) {
+        snprintf(payload, sizeof(payload), "batch=b%d;a=%d;b=%d", k, k, k);
+        deliverRetrying("sc/dev/msg/batch", payload);
+      }
+    }
+    cloudDone = true;
+  });
+  int sets = 0;
+  while (!cloudDone || sets < STRESS_SETS) {
+    counter.setValue(++sets);
+    run(1, 1);
+  }
+  cloud.join();
+
+  // the inbox drops writes while it is full, once loop() has caught up a
+  // last write and batch must arrive
+  for (int i = 0; i < 100; i++) {
+    run(1);
+    pause();
+  }
+  deliverRetrying("sc/dev/msg/recv", "id=target;value=100000");
+  deliverRetrying("sc/dev/msg/batch", "batch=last;a=100000;b=100000");
+  CHECK(runUntil([] { return target.Int() == 100000 && a.Int() == 100000; }));
+  CHECK(b.Int() == 100000);
+  CHECK(targetWrites > 1);
+  CHECK(targetBackwards == 0);
+  CHECK(batches > 1);
+  CHECK(tornBatches == 0);
+  CHECK(runUntil([] { return sent("sc/dev/msg/ack", "batch=last;accepted=2"); }));
+
+  char last[32];
+  snprintf(last, sizeof(last), "id=counter;value=%d", sets);
+  CHECK(runUntil([&last] { return sent("sc/dev/msg/pub", last); }));
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  counter.setDataType(DataType::Integer);
+  target.setDataType(DataType::Integer).setAccessMode(AccessMode::Write).subscribe(onTarget);
+  a.setDataType(DataType::Integer).setAccessMode(AccessMode::Write);
+  b.setDataType(DataType::Integer).setAccessMode(AccessMode::Write);
+  device.onBatch(onAb);
+  RUN(connectsFromSyncThread);
+  RUN(survivesConcurrentWritesAndSets);
+  stopSyncTask();
+  return hostResult();
+}
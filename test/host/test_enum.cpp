@@ -0,0 +1,80 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// EnumProperty: which inbound values it accepts and how its labels are
+// described when they do not all fit in prop/info.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include <string>
+
+#include "HostTest.h"
+
+const char* const modes[] = {"off", "eco", "boost"};
+EnumProperty<3> mode("mode", modes);
+
+const char* const longLabels[] = {
+    "label-number-00-padded-out", "label-number-01-padded-out", "label-number-02-padded-out",
+    "label-number-03-padded-out", "label-number-04-padded-out", "label-number-05-padded-out",
+    "label-number-06-padded-out", "label-number-07-padded-out", "label-number-08-padded-out"};
+EnumProperty<9> verbose("verbose", longLabels);
+
+void acceptsOnlyWholeIndices() {
+  CHECK(mode.accepts("0"));
+  CHECK(mode.accepts("2"));
+  CHECK(mode.accepts("002"));
+  CHECK(!mode.accepts("3"));
+  CHECK(!mode.accepts("1x"));
+  CHECK(!mode.accepts("1 "));
+  CHECK(!mode.accepts("-1"));
+  CHECK(!mode.accepts(""));
+  CHECK(!mode.accepts("0001"));
+  CHECK(!mode.accepts("256"));
+}
+
+void describesLabels() {
+  SensoraPayload payload;
+  mode.describe(payload);
+  CHECK(strcmp(reinterpret_cast<char*>(payload.buffer()), "labels=off,eco,boost") == 0);
+}
+
+void boundsLabelsByPayloadSpace() {
+  SensoraPayload payload;
+  payload.add("id", "verbose");
+  payload.add("nodeId", "");
+  payload.add("dataType", static_cast<uint8_t>(DataType::Enum));
+  payload.add("accessMode", static_cast<uint8_t>(AccessMode::ReadWrite));
+  payload.add("note", std::string(60, 'x').c_str());
+  size_t before = payload.length();
+  verbose.describe(payload);
+  std::string out(reinterpret_cast<char*>(payload.buffer()), payload.length());
+  // the labels are still added, cut at a label boundary
+  CHECK(payload.length() > before);
+  size_t at = out.find(";labels=");
+  CHECK(at != std::string::npos);
+  std::string labels = at == std::string::npos ? "" : out.substr(at + 8);
+  CHECK(labels.rfind("label-number-00-padded-out,", 0) == 0);
+  CHECK(labels.size() >= 26 && labels.compare(labels.size() - 11, 11, "-padded-out") == 0);
+  CHECK(payload.length() < SENSORA_PAYLOAD_SIZE);
+}
+
+int main() {
+  RUN(acceptsOnlyWholeIndices);
+  RUN(describesLabels);
+  RUN(boundsLabelsByPayloadSpace);
+  return hostResult();
+}
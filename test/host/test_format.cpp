@@ -0,0 +1,187 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Number formatting kernels against printf and strtof. By default floats
+// are sampled with a stride, pass --exhaustive to check every float.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include <random>
+
+#include "HostTest.h"
+
+static uint32_t stride = 1021;
+
+static float fromBits(uint32_t bits) {
+  float v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+// fewest significant digits printf needs for a string that reads back as v
+static int printfDigits(float v) {
+  char buf[32];
+  for (int p = 1; p <= 9; p++) {
+    snprintf(buf, sizeof(buf), "%.*g", p, v);
+    if (strtof(buf, nullptr) == v) {
+      return p;
+    }
+  }
+  return 9;
+}
+
+static int significantDigits(const char* s) {
+  int first = -1;
+  int last = -1;
+  int pos = 0;
+  for (; *s != '\0' && *s != 'e'; s++) {
+    if (*s < '0' || *s > '9') {
+      continue;
+    }
+    if (*s != '0') {
+      if (first < 0) {
+        first = pos;
+      }
+      last = pos;
+    }
+    pos++;
+  }
+  return first < 0 ? 1 : last - first + 1;
+}
+
+void formatsKnownFloats() {
+  struct {
+    float v;
+    const char* s;
+  } cases[] = {
+      {0.0f, "0"},          {-0.0f, "-0"},           {1.0f, "1"},           {21.5f, "21.5"},
+      {0.1f, "0.1"},        {-3.25f, "-3.25"},       {1e6f, "1000000"},     {0.9999999f, "0.9999999"},
+      {999999.9f, "999999.9"}, {99999.99f, "99999.99"}, {9.5f, "9.5"},       {1e-6f, "1e-6"},
+      {1e10f, "1e10"},      {3.4028235e38f, "3.4028235e38"}, {1e-45f, "1e-45"},
+  };
+  char out[16];
+  for (const auto& c : cases) {
+    formatFloat(c.v, out);
+    if (strcmp(out, c.s) != 0) {
+      fprintf(stderr, "formatFloat(%.9g) = %s, expected %s\n", c.v, out, c.s);
+      hostFailures++;
+    }
+  }
+  formatFloat(fromBits(0x7fc00000), out);
+  CHECK(strcmp(out, "nan") == 0);
+  formatFloat(-INFINITY, out);
+  CHECK(strcmp(out, "-inf") == 0);
+}
+
+// every sampled float reads back exactly and is no longer than the
+// shortest printf output
+void roundTripsFloats() {
+  unsigned long checked = 0;
+  unsigned long mismatched = 0;
+  unsigned long longer = 0;
+  char out[16];
+  for (uint64_t bits = 0; bits <= 0xffffffffu; bits += stride) {
+    float v = fromBits(bits);
+    if (!isfinite(v)) {
+      continue;
+    }
+    size_t len = formatFloat(v, out);
+    checked++;
+    if (len >= 16 || strtof(out, nullptr) != v) {
+      if (mismatched++ < 5) {
+        fprintf(stderr, "formatFloat(%.9g) = %s does not read back\n", v, out);
+      }
+      continue;
+    }
+    // the printf search is slow, compare lengths on a subset only
+    if (bits % (251 * 64) < stride && significantDigits(out) > printfDigits(v)) {
+      if (longer++ < 5) {
+        fprintf(stderr, "formatFloat(%.9g) = %s, printf needs %d digits\n", v, out, printfDigits(v));
+      }
+    }
+  }
+  CHECK(checked > 0);
+  CHECK(mismatched == 0);
+  CHECK(longer == 0);
+}
+
+void matchesPrintfFixed() {
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> value(-1e6, 1e6);
+  char ours[64];
+  char theirs[64];
+  unsigned long mismatched = 0;
+  for (int i = 0; i < 200000; i++) {
+    double v = i % 4 == 0 ? fromBits(rng()) : value(rng);
+    if (!isfinite(v)) {
+      continue;
+    }
+    uint8_t decimals = i % 10;
+    size_t len = formatFixed(v, decimals, ours, sizeof(ours));
+    int expected = snprintf(theirs, sizeof(theirs), "%.*f", decimals, v);
+    if (len != static_cast<size_t>(expected) || strcmp(ours, theirs) != 0) {
+      if (mismatched++ < 5) {
+        fprintf(stderr, "formatFixed(%.17g, %u) = %s, printf %s\n", v, decimals, ours, theirs);
+      }
+    }
+  }
+  CHECK(mismatched == 0);
+}
+
+void parsesLikeStrtof() {
+  std::mt19937 rng(2);
+  char buf[32];
+  unsigned long mismatched = 0;
+  for (int i = 0; i < 200000; i++) {
+    float v = fromBits(rng());
+    if (!isfinite(v)) {
+      continue;
+    }
+    snprintf(buf, sizeof(buf), i % 2 ? "%.*f" : "%.*g", i % 10, v);
+    if (parseFloat(buf) != strtof(buf, nullptr)) {
+      if (mismatched++ < 5) {
+        fprintf(stderr, "parseFloat(%s) differs from strtof\n", buf);
+      }
+    }
+  }
+  CHECK(mismatched == 0);
+  // just above the midpoint of 1 and the next float, strtod rounds it onto
+  // the midpoint and the cast then rounds down to 1
+  CHECK(parseFloat("1.00000005960464477539062500001") == strtof("1.00000005960464477539062500001", nullptr));
+  CHECK(parseFloat("1.00000005960464477539062500001") > 1.0f);
+  CHECK(parseInt(" -42x") == -42);
+  CHECK(parseInt("+7") == 7);
+}
+
+void formatsIntegers() {
+  char out[12];
+  CHECK(formatInt(0, out) == 1 && strcmp(out, "0") == 0);
+  CHECK(formatInt(-2147483647 - 1, out) == 11 && strcmp(out, "-2147483648") == 0);
+  CHECK(formatUInt(4294967295u, out) == 10 && strcmp(out, "4294967295") == 0);
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--exhaustive") == 0) {
+    stride = 1;
+  }
+  RUN(formatsKnownFloats);
+  RUN(roundTripsFloats);
+  RUN(matchesPrintfFixed);
+  RUN(parsesLikeStrtof);
+  RUN(formatsIntegers);
+  return hostResult();
+}
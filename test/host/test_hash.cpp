@@ -0,0 +1,85 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// SHA-256 and HMAC-SHA256 against published known answers (FIPS 180-2
+// examples and RFC 4231).
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include "HostTest.h"
+
+static bool digestIs(const uint8_t* digest, const char* hex) {
+  char out[2 * SHA256_SIZE + 1];
+  formatHex(digest, SHA256_SIZE, out);
+  return strcmp(out, hex) == 0;
+}
+
+static const uint8_t* bytes(const char* s) {
+  return reinterpret_cast<const uint8_t*>(s);
+}
+
+void hashesKnownMessages() {
+  uint8_t digest[SHA256_SIZE];
+  Sha256 sha;
+  sha.finish(digest);
+  CHECK(digestIs(digest, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"));
+  sha.begin();
+  sha.update(bytes("abc"), 3);
+  sha.finish(digest);
+  CHECK(digestIs(digest, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+  // two blocks once padded
+  const char* two = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  sha.begin();
+  sha.update(bytes(two), strlen(two));
+  sha.finish(digest);
+  CHECK(digestIs(digest, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"));
+}
+
+// the same message fed in chunks that straddle block boundaries
+void hashesChunkedInput() {
+  uint8_t digest[SHA256_SIZE];
+  const char* two = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  size_t len = strlen(two);
+  for (size_t chunk = 1; chunk < len; chunk += 7) {
+    Sha256 sha;
+    for (size_t i = 0; i < len; i += chunk) {
+      sha.update(bytes(two) + i, len - i < chunk ? len - i : chunk);
+    }
+    sha.finish(digest);
+    CHECK(digestIs(digest, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"));
+  }
+}
+
+// RFC 4231 test cases 1 and 6, the latter with a key longer than a block
+void signsRfc4231Cases() {
+  uint8_t mac[SHA256_SIZE];
+  uint8_t key[131];
+  memset(key, 0x0b, 20);
+  hmacSha256(key, 20, bytes("Hi There"), 8, mac);
+  CHECK(digestIs(mac, "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7"));
+  memset(key, 0xaa, sizeof(key));
+  const char* data = "Test Using Larger Than Block-Size Key - Hash Key First";
+  hmacSha256(key, sizeof(key), bytes(data), strlen(data), mac);
+  CHECK(digestIs(mac, "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54"));
+}
+
+int main() {
+  RUN(hashesKnownMessages);
+  RUN(hashesChunkedInput);
+  RUN(signsRfc4231Cases);
+  return hostResult();
+}
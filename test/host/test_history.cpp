@@ -0,0 +1,164 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// HistoryEncoder and HistoryDecoder round trips, and batches filled right
+// up to the end of their storage.
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <SensoraHistory.h>
+
+#include <random>
+#include <vector>
+
+#include "HostTest.h"
+
+struct Point {
+  uint32_t t;
+  float v;
+};
+
+static float fromBits(uint32_t bits) {
+  float v;
+  memcpy(&v, &bits, sizeof(v));
+  return v;
+}
+
+static bool sameValue(float a, float b) {
+  return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// encodes points until the batch is full, returns how many fit and checks
+// that every one of them decodes back unchanged
+static size_t roundTrip(uint8_t* storage, size_t size, const std::vector<Point>& points) {
+  HistoryEncoder encoder;
+  encoder.begin(storage, size, "temp");
+  CHECK(encoder.active());
+  size_t added = 0;
+  while (added < points.size() && encoder.add(points[added].t, points[added].v)) {
+    added++;
+  }
+  size_t len = encoder.seal(points[0].t + 5000);
+  CHECK(len <= size);
+
+  HistoryDecoder decoder(encoder.data(), len);
+  CHECK(decoder.isValid());
+  CHECK(decoder.count() == added);
+  CHECK(decoder.firstAgeMs() == 5000);
+  char id[8];
+  decoder.propertyId(id, sizeof(id));
+  CHECK(strcmp(id, "temp") == 0);
+  uint32_t t;
+  float v;
+  size_t read = 0;
+  while (decoder.next(t, v)) {
+    CHECK(t == points[read].t - points[0].t);
+    CHECK(sameValue(v, points[read].v));
+    read++;
+  }
+  CHECK(read == added);
+  return added;
+}
+
+void decodesRegularSeries() {
+  std::vector<Point> points;
+  std::mt19937 rng(1);
+  std::normal_distribution<float> jitter(0, 3);
+  uint32_t t = 123456;
+  float v = 21.5f;
+  for (int i = 0; i < 900; i++) {
+    t += 1000 + static_cast<int>(jitter(rng));
+    if (i % 10 == 0) {
+      v = roundf((v + jitter(rng) * 0.01f) * 100) / 100;
+    }
+    if (i == 500) {
+      t += 100000;
+    }
+    points.push_back({t, v});
+  }
+  static uint8_t storage[4096];
+  CHECK(roundTrip(storage, sizeof(storage), points) == points.size());
+}
+
+void decodesRandomSeries() {
+  std::vector<Point> points;
+  std::mt19937 rng(2);
+  uint32_t t = 0;
+  for (int i = 0; i < 1000; i++) {
+    t += rng() % 100000;
+    points.push_back({t, fromBits(rng())});
+  }
+  static uint8_t storage[16384];
+  CHECK(roundTrip(storage, sizeof(storage), points) == points.size());
+}
+
+// every storage size from the smallest usable one up, with guard bytes
+// behind the batch that must survive
+void neverWritesPastStorage() {
+  std::mt19937 rng(3);
+  std::vector<Point> points;
+  uint32_t t = 0;
+  uint32_t bits = 0;
+  for (int i = 0; i < 64; i++) {
+    // a delta-of-delta beyond 12 bits takes 36 bits, and XORs alternating
+    // between a window with 3 leading and one with 3 trailing zero bits
+    // start a new 29 bit window every time, 77 bits per point
+    t += (i % 2) ? 1 : 1000000;
+    uint32_t x = rng();
+    x = (i % 2) ? (x & 0x1ffffff0u) | 0x10000001u : (x & 0x7ffffff0u) | 0x80000008u;
+    bits ^= x;
+    points.push_back({t, fromBits(bits)});
+  }
+  const size_t guard = 16;
+  int corrupted = 0;
+  for (size_t size = 4 + 8 + HISTORY_MAX_POINT_SIZE; size < 400; size++) {
+    std::vector<uint8_t> storage(size + guard, 0xA5);
+    size_t added = roundTrip(storage.data(), size, points);
+    CHECK(added > 0);
+    for (size_t i = size; i < size + guard; i++) {
+      corrupted += storage[i] != 0xA5;
+    }
+  }
+  CHECK(corrupted == 0);
+}
+
+void rejectsInvalidBatches() {
+  const uint8_t truncated[] = {HISTORY_VERSION, 200, 'x', 'y', 0, 0, 0, 0, 0};
+  const uint8_t wrongVersion[] = {HISTORY_VERSION + 1, 1, 'x', 0, 0, 0, 0, 0, 0};
+  const uint8_t* batches[] = {truncated, wrongVersion, nullptr};
+  size_t lens[] = {sizeof(truncated), sizeof(wrongVersion), 0};
+  for (int i = 0; i < 3; i++) {
+    HistoryDecoder decoder(batches[i], lens[i]);
+    CHECK(!decoder.isValid());
+    CHECK(decoder.count() == 0 && decoder.firstAgeMs() == 0);
+    char id[8] = "stale";
+    decoder.propertyId(id, sizeof(id));
+    CHECK(id[0] == '\0');
+    decoder.propertyId(id, 0);
+    uint32_t t;
+    float v;
+    CHECK(!decoder.next(t, v));
+  }
+}
+
+int main() {
+  RUN(decodesRegularSeries);
+  RUN(decodesRandomSeries);
+  RUN(neverWritesPastStorage);
+  RUN(rejectsInvalidBatches);
+  return hostResult();
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// LanEndpoint driven by a client on an in-memory socket: the hello
+// handshake, signed reads and writes, replays and forged packets, the
+// separate key that signs responses and a session per controller.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include <deque>
+#include <string>
+
+#include "HostBoard.h"
+#include "HostTest.h"
+
+// Device side of the socket, requests queued by the test are read in order
+// and every response is kept.
+class LanUdp {
+ public:
+  std::deque<std::string> requests;
+  std::deque<std::string> responses;
+
+  uint8_t begin(uint16_t port) { return port != 0; }
+  int parsePacket() {
+    if (requests.empty()) {
+      return 0;
+    }
+    in = requests.front();
+    requests.pop_front();
+    return in.size();
+  }
+  int read(uint8_t* buf, size_t len) {
+    size_t n = len < in.size() ? len : in.size();
+    memcpy(buf, in.data(), n);
+    return n;
+  }
+  IPAddress remoteIP() { return IPAddress(); }
+  uint16_t remotePort() { return 40000; }
+  int beginPacket(IPAddress, uint16_t) {
+    out.clear();
+    return 1;
+  }
+  size_t write(const uint8_t* buf, size_t len) {
+    out.append(reinterpret_cast<const char*>(buf), len);
+    return len;
+  }
+  int endPacket() {
+    responses.push_back(out);
+    return 1;
+  }
+
+ private:
+  std::string in;
+  std::string out;
+};
+
+LanUdp udp;
+LanEndpoint<LanUdp, Device> lan(udp, device, 47123);
+
+Property heater("heater");
+Property temperature("temp");
+
+static void deriveKey(const char* label, uint8_t* key) {
+  hmacSha256(reinterpret_cast<const uint8_t*>("token"), 5, reinterpret_cast<const uint8_t*>(label), strlen(label), key);
+}
+
+static std::string macOf(const uint8_t* key, const std::string& data) {
+  uint8_t mac[SHA256_SIZE];
+  hmacSha256(key, SHA256_SIZE, reinterpret_cast<const uint8_t*>(data.data()), data.size(), mac);
+  char hex[2 * LAN_MAC_SIZE + 1];
+  formatHex(mac, LAN_MAC_SIZE, hex);
+  return hex;
+}
+
+static uint8_t requestKey[SHA256_SIZE];
+static uint8_t responseKey[SHA256_SIZE];
+static std::string nonce;
+
+static std::string send(const std::string& request) {
+  udp.requests.push_back(request);
+  run(1);
+  if (udp.responses.empty()) {
+    return "";
+  }
+  std::string response = udp.responses.front();
+  udp.responses.pop_front();
+  return response;
+}
+
+static std::string callIn(const std::string& session, const std::string& request, const uint8_t* key = requestKey) {
+  std::string signedRequest = "nonce=" + session + ";" + request;
+  return send(signedRequest + ";mac=" + macOf(key, signedRequest));
+}
+
+static std::string call(const std::string& request, const uint8_t* key = requestKey) {
+  return callIn(nonce, request, key);
+}
+
+static std::string hello() {
+  std::string r = send("op=hello");
+  return r.rfind("nonce=", 0) == 0 ? r.substr(6) : "";
+}
+
+// true if response is signed with key, the mac is always the last field
+static bool signedWith(const std::string& response, const uint8_t* key) {
+  size_t at = response.rfind(";mac=");
+  return at != std::string::npos && response.substr(at + 5) == macOf(key, response.substr(0, at));
+}
+
+static bool startsWith(const std::string& s, const char* prefix) {
+  return s.rfind(prefix, 0) == 0;
+}
+
+void handsOutNonce() {
+  startDevice();
+  nonce = hello();
+  CHECK(nonce.size() == 8);
+}
+
+void writesAndReadsProperties() {
+  std::string r = call("seq=1;op=set;id=heater;value=23");
+  CHECK(startsWith(r, "seq=1;id=heater;value=23;mac="));
+  run(3);
+  CHECK(heater.Int() == 23);
+  r = call("seq=2;op=get;id=heater");
+  CHECK(startsWith(r, "seq=2;id=heater;value=23;mac="));
+}
+
+void signsResponsesWithOwnKey() {
+  std::string r = call("seq=3;op=get;id=heater");
+  CHECK(signedWith(r, responseKey));
+  CHECK(!signedWith(r, requestKey));
+}
+
+void refusesBadRequests() {
+  CHECK(startsWith(call("seq=3;op=get;id=heater"), "seq=3;error=replayed"));
+  CHECK(startsWith(call("seq=4;op=set;id=temp;value=1"), "seq=4;error=read_only"));
+  CHECK(startsWith(call("seq=5;op=get;id=nope"), "seq=5;error=unknown_property"));
+  // a response replayed as a request carries the wrong key
+  CHECK(startsWith(call("seq=6;op=set;id=heater;value=1", responseKey), "seq=6;error=unauthorized"));
+  std::string stale = "nonce=00000000;seq=7;op=get;id=heater";
+  CHECK(startsWith(send(stale + ";mac=" + macOf(requestKey, stale)), "seq=7;error=stale_nonce"));
+  CHECK(startsWith(send("nonce=" + nonce + ";seq=8;op=get;id=heater"), "seq=8;error=unauthorized"));
+  run(3);
+  CHECK(heater.Int() == 23);
+}
+
+// a second controller counts its own seq from 1 without breaking the first
+void keepsSessionPerController() {
+  std::string other = hello();
+  CHECK(other.size() == 8);
+  CHECK(other != nonce);
+  CHECK(startsWith(callIn(other, "seq=1;op=get;id=heater"), "seq=1;id=heater;value=23;mac="));
+  CHECK(startsWith(call("seq=9;op=get;id=heater"), "seq=9;id=heater;value=23;mac="));
+  CHECK(startsWith(callIn(other, "seq=1;op=get;id=heater"), "seq=1;error=replayed"));
+  CHECK(startsWith(callIn(other, "seq=2;op=set;id=heater;value=24"), "seq=2;id=heater;value=24;mac="));
+  CHECK(startsWith(call("seq=8;op=get;id=heater"), "seq=8;error=replayed"));
+}
+
+// hellos past SENSORA_LAN_MAX_SESSIONS push out the sessions idle the
+// longest, one in use stays
+void replacesIdleSessions() {
+  std::string idle = hello();
+  for (int i = 0; i < SENSORA_LAN_MAX_SESSIONS; i++) {
+    hostNow += 1000;
+    std::string seq = std::to_string(10 + i);
+    CHECK(startsWith(call("seq=" + seq + ";op=get;id=heater"), ("seq=" + seq + ";id=heater;").c_str()));
+    hello();
+  }
+  CHECK(startsWith(callIn(idle, "seq=1;op=get;id=heater"), "seq=1;error=stale_nonce"));
+  CHECK(startsWith(call("seq=20;op=get;id=heater"), "seq=20;id=heater;"));
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  copyString("token", deviceConfig.deviceToken);
+  deriveKey("sensora-lan", requestKey);
+  deriveKey("sensora-lan-resp", responseKey);
+  heater.setDataType(DataType::Integer).setAccessMode(AccessMode::ReadWrite);
+  temperature.setDataType(DataType::Integer);
+  RUN(handsOutNonce);
+  RUN(writesAndReadsProperties);
+  RUN(signsResponsesWithOwnKey);
+  RUN(refusesBadRequests);
+  RUN(keepsSessionPerController);
+  RUN(replacesIdleSessions);
+  return hostResult();
+}
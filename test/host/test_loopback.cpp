@@ -0,0 +1,97 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A device running over LoopbackTransport: connect, inbound writes,
+// state publishes and reconnecting after the broker goes away.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include "HostBoard.h"
+#include "HostTest.h"
+
+Property temperature("temp");
+Property led("led");
+int ledWrites = 0;
+
+void onLed(PropertyValue& value) {
+  ledWrites++;
+}
+
+void connectsAndSubscribes() {
+  startDevice();
+  CHECK(loopback.connected());
+  CHECK(loopback.isSubscribed("sc/dev/msg/recv"));
+  CHECK(loopback.isSubscribed("sc/dev/prop/led/set"));
+  CHECK(sentMessage(loopback, "sc/dev/dev/info", ""));
+}
+
+void appliesCloudWrites() {
+  deliver("sc/dev/msg/recv", "id=led;value=true");
+  run(3);
+  CHECK(ledWrites == 1);
+  CHECK(led.Bool());
+  // writes to read-only properties are ignored
+  deliver("sc/dev/msg/recv", "id=temp;value=99");
+  run(3);
+  CHECK(temperature.Int() != 99);
+}
+
+void publishesLocalChanges() {
+  temperature.setValue(42);
+  run(3);
+  CHECK(sentMessage(loopback, "sc/dev/msg/pub", "id=temp;value=42"));
+}
+
+void doesNotRateLimitByDefault() {
+  unsigned long before = loopback.sentCount();
+  for (int i = 0; i < 40; i++) {
+    temperature.setValue(100 + i);
+    run(1);
+  }
+  run(3);
+  CHECK(loopback.sentCount() - before >= 40);
+  CHECK(sentMessage(loopback, "sc/dev/msg/pub", "id=temp;value=139"));
+}
+
+void reconnectsAfterBrokerLoss() {
+  loopback.setOnline(false);
+  run(5);
+  CHECK(!loopback.connected());
+  loopback.setOnline(true);
+  for (int i = 0; i < 100 && !loopback.connected(); i++) {
+    run(1);
+    hostNow += 1000;
+  }
+  run(20);
+  CHECK(loopback.connected());
+  CHECK(loopback.isSubscribed("sc/dev/msg/recv"));
+  temperature.setValue(43);
+  run(3);
+  CHECK(sentMessage(loopback, "sc/dev/msg/pub", "id=temp;value=43"));
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  temperature.setDataType(DataType::Integer);
+  led.setDataType(DataType::Boolean).setAccessMode(AccessMode::Write).subscribe(onLed);
+  RUN(connectsAndSubscribes);
+  RUN(appliesCloudWrites);
+  RUN(publishesLocalChanges);
+  RUN(doesNotRateLimitByDefault);
+  RUN(reconnectsAfterBrokerLoss);
+  return hostResult();
+}
@@ -0,0 +1,280 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// MqttSnTransport against an in-memory gateway: the will handshake during
+// CONNECT, registration retransmits, publishes that arrive while a request
+// waits for its acknowledgement and callbacks that publish a reply.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+#include <Transport/MqttSnTransport.h>
+
+#include <deque>
+#include <vector>
+
+#include "HostTest.h"
+
+typedef std::vector<uint8_t> Datagram;
+
+// Gateway side of the socket. Every datagram the client sends is recorded
+// and handed to the gateway, whose replies are read back in order.
+class GatewayUdp : public UDP {
+ public:
+  std::vector<Datagram> sent;
+  std::deque<Datagram> replies;
+  void (*gateway)(GatewayUdp& udp, const Datagram& pkt) = nullptr;
+
+  void reply(MqttSnMsg type, std::initializer_list<uint8_t> body) {
+    Datagram d;
+    d.push_back(body.size() + 2);
+    d.push_back(static_cast<uint8_t>(type));
+    d.insert(d.end(), body.begin(), body.end());
+    replies.push_back(d);
+  }
+
+  void replyPublish(uint16_t topicId, uint16_t msgId, const char* payload) {
+    Datagram d = {0, static_cast<uint8_t>(MqttSnMsg::Publish), MQTTSN_FLAG_QOS_1, static_cast<uint8_t>(topicId >> 8), static_cast<uint8_t>(topicId), static_cast<uint8_t>(msgId >> 8), static_cast<uint8_t>(msgId)};
+    d.insert(d.end(), payload, payload + strlen(payload));
+    d[0] = d.size();
+    replies.push_back(d);
+  }
+
+  size_t count(MqttSnMsg type) const {
+    size_t n = 0;
+    for (const Datagram& d : sent) {
+      n += d[1] == static_cast<uint8_t>(type);
+    }
+    return n;
+  }
+
+  uint8_t begin(uint16_t) { return 1; }
+  void stop() {}
+  int beginPacket(IPAddress, uint16_t) { return beginPacket("", 0); }
+  int beginPacket(const char*, uint16_t) {
+    out.clear();
+    return 1;
+  }
+  size_t write(uint8_t b) {
+    out.push_back(b);
+    return 1;
+  }
+  size_t write(const uint8_t* buf, size_t size) {
+    out.insert(out.end(), buf, buf + size);
+    return size;
+  }
+  int endPacket() {
+    sent.push_back(out);
+    if (gateway != nullptr) {
+      gateway(*this, out);
+    }
+    return 1;
+  }
+  int parsePacket() {
+    if (replies.empty()) {
+      return 0;
+    }
+    in = replies.front();
+    replies.pop_front();
+    inPos = 0;
+    return in.size();
+  }
+  int available() { return in.size() - inPos; }
+  int read() { return inPos < in.size() ? in[inPos++] : -1; }
+  int read(unsigned char* buf, size_t len) {
+    size_t n = len < in.size() - inPos ? len : in.size() - inPos;
+    memcpy(buf, in.data() + inPos, n);
+    inPos += n;
+    return n;
+  }
+  int read(char* buf, size_t len) { return read(reinterpret_cast<unsigned char*>(buf), len); }
+  int peek() { return inPos < in.size() ? in[inPos] : -1; }
+  void flush() { inPos = in.size(); }
+  IPAddress remoteIP() { return IPAddress(); }
+  uint16_t remotePort() { return SENSORA_MQTTSN_PORT; }
+
+ private:
+  Datagram out;
+  Datagram in;
+  size_t inPos = 0;
+};
+
+static uint16_t msgIdOf(const Datagram& d, size_t at) {
+  return (d[at] << 8) | d[at + 1];
+}
+
+// answers CONNECT through the will handshake, SUBSCRIBE with topic id 5 and
+// every REGISTER with topic id 9. The first REGISTER is lost and a publish
+// to the subscribed topic is sent instead of its REGACK.
+static bool dropRegister;
+
+static void gateway(GatewayUdp& udp, const Datagram& d) {
+  switch (static_cast<MqttSnMsg>(d[1])) {
+    case MqttSnMsg::Connect:
+      udp.reply(MqttSnMsg::WillTopicReq, {});
+      break;
+    case MqttSnMsg::WillTopic:
+      udp.reply(MqttSnMsg::WillMsgReq, {});
+      break;
+    case MqttSnMsg::WillMsg:
+      udp.reply(MqttSnMsg::ConnAck, {0x00});
+      break;
+    case MqttSnMsg::Subscribe: {
+      uint16_t id = msgIdOf(d, 3);
+      udp.reply(MqttSnMsg::SubAck, {0x00, 0x00, 0x05, static_cast<uint8_t>(id >> 8), static_cast<uint8_t>(id), 0x00});
+      break;
+    }
+    case MqttSnMsg::Register: {
+      if (dropRegister) {
+        dropRegister = false;
+        udp.replyPublish(5, 77, "id=led;value=true");
+        break;
+      }
+      uint16_t id = msgIdOf(d, 4);
+      udp.reply(MqttSnMsg::RegAck, {0x00, 0x09, static_cast<uint8_t>(id >> 8), static_cast<uint8_t>(id), 0x00});
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+GatewayUdp udp;
+MqttSnTransport<GatewayUdp> transport(udp);
+
+static int received;
+static int receivedDuringRequest;
+static bool inRequest;
+static char receivedTopic[SENSORA_MAX_TOPIC_LEN];
+static char receivedPayload[64];
+
+static void onMessage(int len) {
+  received++;
+  if (inRequest) {
+    receivedDuringRequest++;
+  }
+  copyString(transport.messageTopic(), receivedTopic);
+  int i = 0;
+  for (int b = transport.read(); b >= 0 && i < len; b = transport.read()) {
+    receivedPayload[i++] = b;
+  }
+  receivedPayload[i] = '\0';
+}
+
+void connectsThroughWillHandshake() {
+  udp.gateway = gateway;
+  transport.onMessage(onMessage);
+  transport.setup();
+  CHECK(transport.connect());
+  CHECK(udp.count(MqttSnMsg::Connect) == 1);
+  CHECK(udp.count(MqttSnMsg::WillTopic) == 1);
+  CHECK(udp.count(MqttSnMsg::WillMsg) == 1);
+  CHECK(transport.subscribe("sc/dev/msg/recv") == 1);
+}
+
+void retransmitsRequestAfterInboundPublish() {
+  dropRegister = true;
+  size_t before = udp.sent.size();
+  const char* payload = "id=temp;value=21";
+  inRequest = true;
+  CHECK(transport.publish("sc/dev/msg/pub", reinterpret_cast<const uint8_t*>(payload), strlen(payload)));
+  inRequest = false;
+
+  std::vector<Datagram> out(udp.sent.begin() + before, udp.sent.end());
+  CHECK(out.size() == 4);
+  // REGISTER, PUBACK for the inbound publish, REGISTER again, PUBLISH
+  CHECK(out[0][1] == static_cast<uint8_t>(MqttSnMsg::Register));
+  CHECK(out[1][1] == static_cast<uint8_t>(MqttSnMsg::PubAck));
+  CHECK(msgIdOf(out[1], 4) == 77);
+  CHECK(out[2] == out[0]);
+  CHECK(out[3][1] == static_cast<uint8_t>(MqttSnMsg::Publish));
+  CHECK(msgIdOf(out[3], 3) == 9);
+  CHECK(memcmp(out[3].data() + 7, payload, strlen(payload)) == 0);
+
+  CHECK(received == 0);
+  transport.poll();
+  CHECK(received == 1);
+  CHECK(receivedDuringRequest == 0);
+  CHECK(strcmp(receivedTopic, "sc/dev/msg/recv") == 0);
+  CHECK(strcmp(receivedPayload, "id=led;value=true") == 0);
+}
+
+void rejectsPublishWhenQueueIsFull() {
+  for (int i = 0; i < SENSORA_MQTTSN_RX_QUEUE_SIZE + 1; i++) {
+    udp.replyPublish(5, 100 + i, "id=led;value=false");
+  }
+  received = 0;
+  transport.poll();
+  CHECK(received == SENSORA_MQTTSN_RX_QUEUE_SIZE + 1);
+
+  // a publish arriving while the queue is full is refused with congestion
+  size_t before = udp.sent.size();
+  for (int i = 0; i < SENSORA_MQTTSN_RX_QUEUE_SIZE + 1; i++) {
+    udp.replyPublish(5, 200 + i, "id=led;value=true");
+  }
+  dropRegister = false;
+  const char* payload = "x=1";
+  received = 0;
+  CHECK(transport.publish("sc/dev/other", reinterpret_cast<const uint8_t*>(payload), strlen(payload)));
+  uint8_t lastRc = 0xFF;
+  for (size_t i = before; i < udp.sent.size(); i++) {
+    if (udp.sent[i][1] == static_cast<uint8_t>(MqttSnMsg::PubAck)) {
+      lastRc = udp.sent[i][6];
+    }
+  }
+  transport.poll();
+  CHECK(received == SENSORA_MQTTSN_RX_QUEUE_SIZE);
+  CHECK(lastRc == 0x01);
+}
+
+// answers every message like a call handler, publishing from the callback
+static int depth;
+static int maxDepth;
+static int replies;
+
+static void onCall(int len) {
+  depth++;
+  maxDepth = depth > maxDepth ? depth : maxDepth;
+  received++;
+  while (transport.read() >= 0) {
+  }
+  const char* res = "cid=1;ok=true";
+  if (transport.publish("sc/dev/rpc/res", reinterpret_cast<const uint8_t*>(res), strlen(res))) {
+    replies++;
+  }
+  depth--;
+}
+
+void publishesFromMessageCallback() {
+  transport.onMessage(onCall);
+  received = 0;
+  // the reply needs a REGISTER, which the gateway answers with another call
+  dropRegister = true;
+  udp.replyPublish(5, 300, "cid=1;method=ping");
+  transport.poll();
+  CHECK(received == 2);
+  CHECK(replies == 2);
+  CHECK(maxDepth == 1);
+  transport.onMessage(onMessage);
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  RUN(connectsThroughWillHandshake);
+  RUN(retransmitsRequestAfterInboundPublish);
+  RUN(rejectsPublishWhenQueueIsFull);
+  RUN(publishesFromMessageCallback);
+  return hostResult();
+}
@@ -0,0 +1,305 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// OtaUpdater against an HTTP server on a loopback socket: a download cut
+// off halfway and resumed with a Range request, a server that ignores the
+// range, a corrupted image and URLs the client cannot fetch.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HostBoard.h"
+#include "HostTest.h"
+
+// Serves image over HTTP/1.1. The first dropFirst connections are closed a
+// third of the way into the body, Range is answered with 206 unless
+// ignoreRange is set.
+class ImageServer {
+ public:
+  std::vector<uint8_t> image;
+  std::atomic<int> connections{0};
+  std::atomic<int> ranged{0};
+  int dropFirst = 0;
+  bool ignoreRange = false;
+  uint16_t port = 0;
+
+  void start() {
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listener, reinterpret_cast<sockaddr*>(&a), sizeof(a));
+    socklen_t len = sizeof(a);
+    getsockname(listener, reinterpret_cast<sockaddr*>(&a), &len);
+    port = ntohs(a.sin_port);
+    listen(listener, 4);
+    thread = std::thread([this] { serve(); });
+  }
+
+  void stop() {
+    shutdown(listener, SHUT_RDWR);
+    close(listener);
+    thread.join();
+  }
+
+ private:
+  int listener = -1;
+  std::thread thread;
+
+  void serve() {
+    for (;;) {
+      int c = accept(listener, nullptr, nullptr);
+      if (c < 0) {
+        return;
+      }
+      std::string request;
+      char buf[512];
+      while (request.find("\r\n\r\n") == std::string::npos) {
+        ssize_t n = recv(c, buf, sizeof(buf), 0);
+        if (n <= 0) {
+          break;
+        }
+        request.append(buf, n);
+      }
+      size_t from = 0;
+      size_t at = request.find("Range: bytes=");
+      if (at != std::string::npos && !ignoreRange) {
+        from = strtoul(request.c_str() + at + 13, nullptr, 10);
+      }
+      if (from > 0) {
+        ranged++;
+      }
+      size_t end = image.size();
+      if (connections++ < dropFirst) {
+        end = from + (image.size() - from) / 3;
+      }
+      char header[128];
+      int len = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Length: %u\r\n\r\n",
+                         from > 0 ? "206 Partial Content" : "200 OK", static_cast<unsigned>(image.size() - from));
+      send(c, header, len, MSG_NOSIGNAL);
+      send(c, image.data() + from, end - from, MSG_NOSIGNAL);
+      close(c);
+    }
+  }
+};
+
+// non-blocking TCP client with the Arduino Client calls the updater uses
+class PosixClient {
+ public:
+  int connect(const char* host, uint16_t port) {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in a{};
+    a.sin_family = AF_INET;
+    a.sin_port = htons(port);
+    inet_pton(AF_INET, host, &a.sin_addr);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&a), sizeof(a)) != 0) {
+      stop();
+      return 0;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    closed = false;
+    return 1;
+  }
+  size_t write(const uint8_t* buf, size_t len) { return send(fd, buf, len, MSG_NOSIGNAL); }
+  int available() {
+    uint8_t buf[4096];
+    ssize_t n = fd < 0 ? -1 : recv(fd, buf, sizeof(buf), MSG_PEEK);
+    if (n == 0) {
+      closed = true;
+    }
+    return n > 0 ? n : 0;
+  }
+  int read() {
+    uint8_t c;
+    return recv(fd, &c, 1, 0) == 1 ? c : -1;
+  }
+  int read(uint8_t* buf, size_t len) { return recv(fd, buf, len, 0); }
+  uint8_t connected() {
+    available();
+    return fd >= 0 && !closed;
+  }
+  void stop() {
+    if (fd >= 0) {
+      close(fd);
+    }
+    fd = -1;
+  }
+
+ private:
+  int fd = -1;
+  bool closed = false;
+};
+
+// keeps the image in a temporary file, like a flash partition
+class FileOtaWriter : public OtaWriter {
+ public:
+  bool finished = false;
+  bool aborted = false;
+  bool restarted = false;
+
+  bool begin(size_t size) {
+    close();
+    file = tmpfile();
+    finished = aborted = restarted = false;
+    return file != nullptr;
+  }
+  bool write(const uint8_t* data, size_t len) { return fwrite(data, 1, len, file) == len; }
+  bool finish() {
+    finished = true;
+    return true;
+  }
+  // keeps the file so a test can look at what was written
+  void abort() { aborted = true; }
+  void restart() { restarted = true; }
+
+  std::vector<uint8_t> contents() {
+    std::vector<uint8_t> data;
+    if (file == nullptr) {
+      return data;
+    }
+    fflush(file);
+    rewind(file);
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+      data.insert(data.end(), buf, buf + n);
+    }
+    return data;
+  }
+
+  void close() {
+    if (file != nullptr) {
+      fclose(file);
+    }
+    file = nullptr;
+  }
+
+ private:
+  FILE* file = nullptr;
+};
+
+PosixClient client;
+FileOtaWriter writer;
+OtaUpdater<PosixClient, Device> ota(client, writer, device);
+ImageServer server;
+
+static std::string digestOf(const std::vector<uint8_t>& data) {
+  Sha256 sha;
+  uint8_t digest[SHA256_SIZE];
+  sha.begin();
+  sha.update(data.data(), data.size());
+  sha.finish(digest);
+  char hex[2 * SHA256_SIZE + 1];
+  formatHex(digest, SHA256_SIZE, hex);
+  return hex;
+}
+
+static void call(const std::string& url, const std::string& sha256) {
+  std::string request = "cid=1;method=ota;url=" + url + ";size=" + std::to_string(server.image.size()) + ";sha256=" + sha256;
+  deliver("sc/dev/rpc/req", request.c_str());
+}
+
+static std::string localUrl() {
+  return "http://127.0.0.1:" + std::to_string(server.port) + "/fw.bin";
+}
+
+// runs until the device restarts or the update stops, the clock moves 1 ms
+// per step and real time at least 50 us so the server is never timed out
+static void download() {
+  for (int i = 0; i < 200000 && !writer.restarted && ota.busy(); i++) {
+    run(1, 1);
+    usleep(50);
+  }
+}
+
+void connects() {
+  startDevice();
+  CHECK(loopback.connected());
+}
+
+void refusesUnsupportedUrls() {
+  std::string digest = digestOf(server.image);
+  call("https://127.0.0.1/fw.bin", digest);
+  run(1);
+  CHECK(sentMessage(loopback, "sc/dev/rpc/res", "cid=1;reason=unsupported_scheme"));
+  call("ftp://127.0.0.1/fw.bin", digest);
+  run(1);
+  CHECK(sentMessage(loopback, "sc/dev/rpc/res", "cid=1;reason=invalid_argument"));
+  CHECK(!ota.busy());
+}
+
+void skipsResentBytesAndChecksHash() {
+  // the retry is answered with the whole image again, the bytes already
+  // written are skipped, and the wrong digest fails the update at the end
+  server.ignoreRange = true;
+  server.dropFirst = 1;
+  server.connections = 0;
+  std::string digest = digestOf(server.image);
+  digest[0] = digest[0] == '0' ? '1' : '0';
+  call(localUrl(), digest);
+  run(1);
+  CHECK(sentMessage(loopback, "sc/dev/rpc/res", "cid=1;state=downloading"));
+  download();
+  CHECK(!ota.busy());
+  CHECK(writer.aborted && !writer.finished);
+  CHECK(writer.contents() == server.image);
+  CHECK(server.connections == 2);
+  CHECK(sentMessage(loopback, "sc/dev/ota/status", "state=failed;progress=90;error=hash_mismatch"));
+}
+
+// last, the updater then waits for the restart
+void resumesDroppedDownload() {
+  server.ignoreRange = false;
+  server.dropFirst = 2;
+  server.connections = 0;
+  server.ranged = 0;
+  call(localUrl(), digestOf(server.image));
+  run(1);
+  CHECK(sentMessage(loopback, "sc/dev/rpc/res", "cid=1;state=downloading"));
+  download();
+  CHECK(writer.finished && writer.restarted);
+  CHECK(writer.contents() == server.image);
+  CHECK(server.connections == 3);
+  CHECK(server.ranged == 2);
+  CHECK(sentMessage(loopback, "sc/dev/ota/status", "state=done;progress=100"));
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  server.image.resize(150000);
+  for (size_t i = 0; i < server.image.size(); i++) {
+    server.image[i] = static_cast<uint8_t>(i * 2654435761u >> 13);
+  }
+  server.start();
+  RUN(connects);
+  RUN(refusesUnsupportedUrls);
+  RUN(skipsResentBytesAndChecksHash);
+  RUN(resumesDroppedDownload);
+  server.stop();
+  writer.close();
+  return hostResult();
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Critical properties jump the queue: with one publish per loop() their
+// changes still go out on the next loop(), first.
+
+#define DEVICE_SYNC_MAX_PUBLISHES 1
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include "HostBoard.h"
+#include "HostTest.h"
+
+Property n1("n1");
+Property n2("n2");
+Property n3("n3");
+Property n4("n4");
+Property alarm("alarm");
+
+// first message published since sentCount() was before
+static const LoopbackMessage* firstSince(unsigned long before) {
+  unsigned long n = loopback.sentCount() - before;
+  return n == 0 ? nullptr : loopback.sent(n - 1);
+}
+
+static bool isPublish(const LoopbackMessage* m, const char* payload) {
+  return m != nullptr && strcmp(m->topic, "sc/dev/msg/pub") == 0 && m->len == strlen(payload) && memcmp(m->payload, payload, m->len) == 0;
+}
+
+static void setNormal(int v) {
+  n1.setValue(v);
+  n2.setValue(v);
+  n3.setValue(v);
+  n4.setValue(v);
+}
+
+void sortsCriticalFirst() {
+  CHECK(propertyList.begin()[0] == &alarm);
+  startDevice();
+  run(20);
+}
+
+void preemptsQueuedNormalUpdates() {
+  setNormal(1);
+  run(1);
+  alarm.setValue(1);
+  unsigned long before = loopback.sentCount();
+  run(1);
+  CHECK(isPublish(firstSince(before), "id=alarm;value=1"));
+  CHECK(loopback.sentCount() - before == 2);
+  // the walk carries on where it was and the normal updates all go out
+  run(10);
+  CHECK(sentMessage(loopback, "sc/dev/msg/pub", "id=n4;value=1"));
+}
+
+void preemptsStatsSync() {
+  setNormal(2);
+  hostNow += DEVICE_STATS_SYNC_INTERVAL_MS;
+  run(1);
+  alarm.setValue(2);
+  unsigned long before = loopback.sentCount();
+  run(1);
+  CHECK(isPublish(firstSince(before), "id=alarm;value=2"));
+  run(10);
+  CHECK(sentMessage(loopback, "sc/dev/dev/info", ""));
+  CHECK(sentMessage(loopback, "sc/dev/msg/pub", "id=n4;value=2"));
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  alarm.setDataType(DataType::Integer).setPriority(Priority::Critical);
+  RUN(sortsCriticalFirst);
+  RUN(preemptsQueuedNormalUpdates);
+  RUN(preemptsStatsSync);
+  return hostResult();
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// SpscQueue with a producer and a consumer on separate threads. Items are
+// wider than a word so a torn copy shows up as mismatched fields.
+
+#include <stddef.h>
+#include <SensoraQueue.h>
+
+#include <thread>
+
+#include "HostTest.h"
+
+struct Item {
+  unsigned long seq;
+  unsigned long words[7];
+};
+
+void fillsAndDrains() {
+  SpscQueue<int, 4> q;
+  int v;
+  CHECK(!q.pop(v));
+  for (int i = 0; i < 4; i++) {
+    CHECK(q.push(i));
+  }
+  CHECK(!q.push(4));
+  CHECK(q.size() == 4);
+  CHECK(q.at(1) == 1);
+  for (int i = 0; i < 4; i++) {
+    CHECK(q.pop(v) && v == i);
+  }
+  CHECK(!q.pop(v));
+  CHECK(q.size() == 0);
+}
+
+void keepsOrderAcrossThreads() {
+  static SpscQueue<Item, 16> q;
+  const unsigned long count = 2000000;
+  std::thread producer([&] {
+    Item item;
+    for (unsigned long i = 0; i < count;) {
+      item.seq = i;
+      for (unsigned long& w : item.words) {
+        w = i * 2654435761UL;
+      }
+      if (q.push(item)) {
+        i++;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+  unsigned long expected = 0;
+  unsigned long torn = 0;
+  unsigned long reordered = 0;
+  Item item;
+  while (expected < count) {
+    if (!q.pop(item)) {
+      std::this_thread::yield();
+      continue;
+    }
+    reordered += item.seq != expected;
+    for (unsigned long w : item.words) {
+      torn += w != item.seq * 2654435761UL;
+    }
+    expected++;
+  }
+  producer.join();
+  CHECK(reordered == 0);
+  CHECK(torn == 0);
+  CHECK(q.size() == 0);
+}
+
+int main() {
+  RUN(fillsAndDrains);
+  RUN(keepsOrderAcrossThreads);
+  return hostResult();
+}
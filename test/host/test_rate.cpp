@@ -0,0 +1,105 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A property set every 10 ms but limited to one publish per second: the
+// limit holds, the newest value still goes out and the held back values
+// are counted in dev/info.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include "HostBoard.h"
+#include "HostTest.h"
+
+Property fast("fast");
+
+unsigned long seen = 0;
+
+// publishes of fast since the last call, lastValue gets the newest value
+static int newPublishes(int& lastValue) {
+  int n = 0;
+  for (unsigned long i = loopback.sentCount() - seen; i > 0; i--) {
+    const LoopbackMessage* m = loopback.sent(i - 1);
+    char value[PROPERTY_BUFFER_SIZE];
+    if (m != nullptr && strstr(m->topic, "msg/pub") != nullptr && extractPayload(m->payload, m->len, "value", value, sizeof(value))) {
+      lastValue = parseInt(value);
+      n++;
+    }
+  }
+  seen = loopback.sentCount();
+  return n;
+}
+
+int setValues = 0;
+int lastPublished = -1;
+
+void limitsPublishes() {
+  startDevice();
+  newPublishes(lastPublished);
+  int published = 0;
+  // two seconds of a new value every 10 ms
+  for (; setValues < 200; setValues++) {
+    fast.setValue(setValues);
+    run(1);
+    published += newPublishes(lastPublished);
+  }
+  // the initial token and one refill per second
+  CHECK(published >= 2);
+  CHECK(published <= 3);
+  CHECK(lastPublished < setValues - 1);
+}
+
+void flushesNewestValueAfterRefill() {
+  int published = 0;
+  for (int i = 0; i < 110 && lastPublished != setValues - 1; i++) {
+    run(1);
+    published += newPublishes(lastPublished);
+  }
+  CHECK(published == 1);
+  CHECK(lastPublished == setValues - 1);
+  // nothing left to send
+  run(200);
+  CHECK(newPublishes(lastPublished) == 0);
+}
+
+void countsSuppressedValues() {
+  hostNow += DEVICE_STATS_SYNC_INTERVAL_MS;
+  run(3);
+  const LoopbackMessage* info = nullptr;
+  for (unsigned long i = 0; loopback.sent(i) != nullptr; i++) {
+    if (strstr(loopback.sent(i)->topic, "dev/info") != nullptr) {
+      info = loopback.sent(i);
+      break;
+    }
+  }
+  CHECK(info != nullptr);
+  char value[12] = "";
+  if (info != nullptr) {
+    extractPayload(info->payload, info->len, "rate_suppressed", value, sizeof(value));
+  }
+  // every held back value counts once, however often it was retried
+  CHECK(parseInt(value) > 150);
+  CHECK(parseInt(value) <= setValues - 2);
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  fast.setDataType(DataType::Integer).setRateLimit(1);
+  RUN(limitsPublishes);
+  RUN(flushesNewestValueAfterRefill);
+  RUN(countsSuppressedValues);
+  return hostResult();
+}
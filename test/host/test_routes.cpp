@@ -0,0 +1,81 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Topic routing on a session resumed after deep sleep, and groups or the
+// broadcast topic added while the device is already online.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include "HostBoard.h"
+#include "HostTest.h"
+
+Property led("led");
+Property level("level");
+
+void routesOnResumedSession() {
+  // the broker kept the subscriptions made before the device went to sleep
+  loopback.setPersistentSession(true);
+  loopback.connect();
+  loopback.subscribe("sc/dev/msg/recv");
+  loopback.subscribe("sc/dev/prop/+/set");
+  loopback.stop();
+  sensoraRtc.magic = SENSORA_RTC_MAGIC;
+  sensoraRtc.propertyCount = propertyList.count();
+  sensoraRtc.infoSynced = true;
+  hostWoke = true;
+  startDevice();
+  CHECK(loopback.connected());
+  // no full sync, the cloud already has the device info
+  CHECK(!sentMessage(loopback, "sc/dev/dev/info", "fw_version="));
+  deliver("sc/dev/prop/led/set", "true");
+  deliver("sc/dev/msg/recv", "id=level;value=7");
+  run(3);
+  CHECK(led.Bool());
+  CHECK(level.Int() == 7);
+}
+
+void joinsGroupWhileOnline() {
+  CHECK(!loopback.isSubscribed("sc/group/floor1/msg/recv"));
+  CHECK(device.joinGroup("floor1"));
+  run(10);
+  CHECK(loopback.isSubscribed("sc/group/floor1/msg/recv"));
+  deliver("sc/group/floor1/msg/recv", "id=level;value=8");
+  // routes to the device topics survive the rebuild
+  deliver("sc/dev/prop/led/set", "false");
+  run(3);
+  CHECK(level.Int() == 8);
+  CHECK(!led.Bool());
+}
+
+void enablesBroadcastWhileOnline() {
+  device.enableBroadcast();
+  run(10);
+  CHECK(loopback.isSubscribed("sc/broadcast/msg/recv"));
+  deliver("sc/broadcast/msg/recv", "id=level;value=9");
+  run(3);
+  CHECK(level.Int() == 9);
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  led.setDataType(DataType::Boolean).setAccessMode(AccessMode::ReadWrite);
+  level.setDataType(DataType::Integer).setAccessMode(AccessMode::ReadWrite);
+  RUN(routesOnResumedSession);
+  RUN(joinsGroupWhileOnline);
+  RUN(enablesBroadcastWhileOnline);
+  return hostResult();
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Methods called over sc/<id>/rpc/req and answered on sc/<id>/rpc/res,
+// and the method list announced in dev/info.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include <string>
+
+#include "HostBoard.h"
+#include "HostTest.h"
+
+Property level("level");
+
+bool add(const uint8_t* request, int length, SensoraPayload& response) {
+  char a[12];
+  char b[12];
+  if (!extractPayload(request, length, "a", a, sizeof(a)) || !extractPayload(request, length, "b", b, sizeof(b))) {
+    return false;
+  }
+  response.add("sum", static_cast<uint32_t>(parseInt(a) + parseInt(b)));
+  return true;
+}
+
+// changes a property from the handler, which must go out as a normal publish
+bool setLevel(const uint8_t* request, int length, SensoraPayload& response) {
+  char v[12];
+  if (!extractPayload(request, length, "value", v, sizeof(v))) {
+    return false;
+  }
+  level.setValue(parseInt(v));
+  return true;
+}
+
+Method addMethod("add", add);
+Method setLevelMethod("set_level", setLevel);
+
+static void call(const char* payload) {
+  deliver("sc/dev/rpc/req", payload);
+}
+
+void announcesMethods() {
+  startDevice();
+  CHECK(loopback.isSubscribed("sc/dev/rpc/req"));
+  bool found = false;
+  for (unsigned long i = 0; loopback.sent(i) != nullptr; i++) {
+    const LoopbackMessage* m = loopback.sent(i);
+    std::string payload(reinterpret_cast<const char*>(m->payload), m->len);
+    if (strstr(m->topic, "dev/info") != nullptr && payload.find("methods=add,set_level") != std::string::npos) {
+      found = true;
+    }
+  }
+  CHECK(found);
+}
+
+void answersPipelinedCalls() {
+  call("cid=7;method=add;a=2;b=40");
+  call("cid=8;method=nope");
+  call("cid=9;method=add;a=1");
+  run(1);
+  CHECK(sentMessage(loopback, "sc/dev/rpc/res", "cid=7;sum=42"));
+  CHECK(sentMessage(loopback, "sc/dev/rpc/res", "cid=8;error=unknown_method"));
+  CHECK(sentMessage(loopback, "sc/dev/rpc/res", "cid=9;error=failed"));
+}
+
+void ignoresCallsWithoutId() {
+  unsigned long before = loopback.sentCount();
+  call("method=add;a=1;b=1");
+  run(1);
+  CHECK(loopback.sentCount() == before);
+}
+
+void handlersCanSetProperties() {
+  call("cid=10;method=set_level;value=5");
+  run(3);
+  CHECK(sentMessage(loopback, "sc/dev/rpc/res", "cid=10"));
+  CHECK(level.Int() == 5);
+  CHECK(sentMessage(loopback, "sc/dev/msg/pub", "id=level;value=5"));
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  level.setDataType(DataType::Integer);
+  RUN(announcesMethods);
+  RUN(answersPipelinedCalls);
+  RUN(ignoresCallsWithoutId);
+  RUN(handlersCanSetProperties);
+  return hostResult();
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// PropertyValue seqlock: readers on other threads never see a torn value
+// and a write that overlaps another one is applied instead of dropped.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include <atomic>
+#include <thread>
+
+#include "HostTest.h"
+
+// exposes the write section so a test can overlap it like an interrupt
+class TestValue : public PropertyValue {
+ public:
+  void interruptWrite(const char* late) {
+    CHECK(beginWrite());
+    setValue(late);
+    endWrite();
+  }
+};
+
+// "<n>:" followed by a run of the letter n picks, with a length that varies
+// with n, so a mix of two writes never parses back
+static size_t makeValue(unsigned long n, char* out) {
+  int head = snprintf(out, PROPERTY_BUFFER_SIZE, "%lu:", n);
+  size_t body = n % (PROPERTY_BUFFER_SIZE - head - 1);
+  memset(out + head, 'a' + n % 26, body);
+  out[head + body] = '\0';
+  return head + body;
+}
+
+static bool consistent(const char* v) {
+  char expected[PROPERTY_BUFFER_SIZE];
+  makeValue(strtoul(v, nullptr, 10), expected);
+  return strcmp(v, expected) == 0;
+}
+
+void appliesWriteThatOverlapsAnother() {
+  TestValue value;
+  value.setValue("before");
+  value.interruptWrite("late");
+  char v[PROPERTY_BUFFER_SIZE];
+  value.snapshot(v);
+  CHECK(strcmp(v, "late") == 0);
+}
+
+void readersNeverSeeTornValues() {
+  static PropertyValue value;
+  const unsigned long writes = 500000;
+  std::atomic<bool> done(false);
+  char v[PROPERTY_BUFFER_SIZE];
+  makeValue(0, v);
+  value.setValue(v);
+
+  std::thread writerA([&] {
+    char w[PROPERTY_BUFFER_SIZE];
+    for (unsigned long i = 1; i <= writes; i++) {
+      makeValue(2 * i, w);
+      value.setValue(w);
+    }
+  });
+  std::thread writerB([&] {
+    char w[PROPERTY_BUFFER_SIZE];
+    for (unsigned long i = 1; i <= writes; i++) {
+      makeValue(2 * i + 1, w);
+      value.setValue(w);
+    }
+  });
+  std::thread stopper([&] {
+    writerA.join();
+    writerB.join();
+    done = true;
+  });
+
+  unsigned long reads = 0;
+  unsigned long torn = 0;
+  while (!done) {
+    value.snapshot(v);
+    torn += !consistent(v);
+    reads++;
+  }
+  stopper.join();
+  CHECK(reads > 0);
+  CHECK(torn == 0);
+
+  // the final value is the last write of one of the writers
+  value.snapshot(v);
+  unsigned long last = strtoul(v, nullptr, 10);
+  CHECK(last == 2 * writes || last == 2 * writes + 1);
+}
+
+int main() {
+  RUN(appliesWriteThatOverlapsAnother);
+  RUN(readersNeverSeeTornValues);
+  return hostResult();
+}
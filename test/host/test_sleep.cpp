@@ -0,0 +1,60 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Cloud sync state kept in RTC memory across deep sleep, matched back to
+// the properties by id even when their order changes.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include "HostBoard.h"
+#include "HostTest.h"
+
+Property first("first");
+Property second("second");
+
+void savesStateBeforeSleep() {
+  device.setSleepCycle(60);
+  device.setup();
+  first.setValue(1);
+  second.setValue(2);
+  run(40);
+  CHECK(hostSleptFor == 60);
+  CHECK(strcmp(first.getCloudValue(), "1") == 0);
+  CHECK(strcmp(second.getCloudValue(), "2") == 0);
+}
+
+void restoresByIdAfterReorder() {
+  CHECK(propertyList.begin()[0] == &first);
+  // a new firmware, or a setPriority() call, puts second ahead of first
+  second.setPriority(Priority::High);
+  CHECK(propertyList.begin()[0] == &second);
+  first.restoreCloudState("", 0);
+  second.restoreCloudState("", 0);
+  hostWoke = true;
+  device.setup();
+  CHECK(strcmp(first.getCloudValue(), "1") == 0);
+  CHECK(strcmp(second.getCloudValue(), "2") == 0);
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  first.setDataType(DataType::Integer);
+  second.setDataType(DataType::Integer);
+  RUN(savesStateBeforeSleep);
+  RUN(restoresByIdAfterReorder);
+  return hostResult();
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Property info and state sync spread over several loop() calls when the
+// publish budget is smaller than the property list.
+
+#define DEVICE_SYNC_MAX_PUBLISHES 2
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include <set>
+#include <string>
+
+#include "HostBoard.h"
+#include "HostTest.h"
+
+#define PROPERTY_COUNT 7
+
+const char* const ids[PROPERTY_COUNT] = {"p0", "p1", "p2", "p3", "p4", "p5", "p6"};
+Property* props[PROPERTY_COUNT];
+
+// runs one loop() and adds the ids published to topicPart to out, returns
+// how many were published
+static int loopOnce(const char* topicPart, std::set<std::string>& out) {
+  unsigned long before = loopback.sentCount();
+  run(1);
+  int n = 0;
+  for (unsigned long i = 0; i < loopback.sentCount() - before; i++) {
+    const LoopbackMessage* m = loopback.sent(i);
+    char id[SENSORA_MAX_PROPERTY_ID_LEN];
+    if (m != nullptr && strstr(m->topic, topicPart) != nullptr && extractPayload(m->payload, m->len, "id", id, sizeof(id))) {
+      out.insert(id);
+      n++;
+    }
+  }
+  return n;
+}
+
+void slicesPropertyInfo() {
+  device.setup();
+  std::set<std::string> described;
+  int loops = 0;
+  for (int i = 0; i < 50 && described.size() < PROPERTY_COUNT; i++) {
+    int n = loopOnce("prop/info", described);
+    CHECK(n <= 2);
+    if (n > 0) {
+      loops++;
+    }
+  }
+  CHECK(described.size() == PROPERTY_COUNT);
+  CHECK(loops >= (PROPERTY_COUNT + 1) / 2);
+  run(20);
+}
+
+void slicesPropertyState() {
+  for (int i = 0; i < PROPERTY_COUNT; i++) {
+    props[i]->setValue(100 + i);
+  }
+  std::set<std::string> published;
+  int loops = 0;
+  for (int i = 0; i < 50 && published.size() < PROPERTY_COUNT; i++) {
+    int n = loopOnce("msg/pub", published);
+    CHECK(n <= 2);
+    if (n > 0) {
+      loops++;
+    }
+  }
+  CHECK(published.size() == PROPERTY_COUNT);
+  CHECK(loops >= (PROPERTY_COUNT + 1) / 2);
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  for (int i = 0; i < PROPERTY_COUNT; i++) {
+    props[i] = new Property(ids[i]);
+    props[i]->setDataType(DataType::Integer);
+  }
+  RUN(slicesPropertyInfo);
+  RUN(slicesPropertyState);
+  return hostResult();
+}
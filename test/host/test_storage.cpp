@@ -0,0 +1,79 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// StoragePreferences: the write cache in front of the two-slot records and
+// when it flushes to flash.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+#include <Storage/StoragePreferences.h>
+
+#include "HostTest.h"
+
+struct Setting {
+  uint32_t value;
+};
+
+void readsBackWrites() {
+  storageBegin();
+  Setting s = {7};
+  writeConfig("speed", s);
+  Setting r = {0};
+  CHECK(readConfig("speed", r) && r.value == 7);
+  storageFlush();
+  CHECK(preferences.puts == 1);
+}
+
+void flushesKeyWrittenAllTheTime() {
+  unsigned long puts = preferences.puts;
+  Setting s = {0};
+  // a new value every second, never quiet for STORAGE_FLUSH_DELAY_MS
+  for (int i = 1; i <= 3 * STORAGE_FLUSH_DELAY_MS / 1000; i++) {
+    s.value = i;
+    writeConfig("speed", s);
+    hostNow += 1000;
+    storageLoop();
+  }
+  CHECK(preferences.puts - puts >= 2);
+  CHECK(preferences.puts - puts <= 3);
+}
+
+void coalescesWritesWithinDelay() {
+  storageFlush();
+  unsigned long puts = preferences.puts;
+  Setting s = {100};
+  for (int i = 0; i < 10; i++) {
+    s.value++;
+    writeConfig("speed", s);
+    hostNow += STORAGE_FLUSH_DELAY_MS / 20;
+    storageLoop();
+  }
+  CHECK(preferences.puts == puts);
+  hostNow += STORAGE_FLUSH_DELAY_MS;
+  storageLoop();
+  CHECK(preferences.puts == puts + 1);
+  // the newest value is what reached flash, even after the cache is gone
+  memset(storageCache, 0, sizeof(storageCache));
+  Setting r = {0};
+  CHECK(readConfig("speed", r) && r.value == 110);
+}
+
+int main() {
+  RUN(readsBackWrites);
+  RUN(flushesKeyWrittenAllTheTime);
+  RUN(coalescesWritesWithinDelay);
+  return hostResult();
+}
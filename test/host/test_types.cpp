@@ -0,0 +1,96 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Hex helpers and the color and location value types, including the
+// validation that refuses malformed inbound writes.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include "HostBoard.h"
+#include "HostTest.h"
+
+Property lamp("lamp");
+Property place("place");
+
+void formatsAndParsesHex() {
+  const uint8_t data[] = {0x00, 0x9f, 0xa0, 0xff};
+  char out[12];
+  CHECK(formatHex(data, 4, out) == 8 && strcmp(out, "009fa0ff") == 0);
+  CHECK(formatHex(data, 4, out, ':', true) == 11 && strcmp(out, "00:9F:A0:FF") == 0);
+  CHECK(formatHex(data, 0, out) == 0 && out[0] == '\0');
+  uint8_t back[4] = {1, 2, 3, 4};
+  CHECK(parseHex("009FA0ff", back, 4) && memcmp(back, data, 4) == 0);
+  uint8_t keep[2] = {7, 7};
+  CHECK(!parseHex("00g0", keep, 2));
+  CHECK(!parseHex("000", keep, 2));
+  CHECK(!parseHex("00000", keep, 2));
+  CHECK(keep[0] == 7 && keep[1] == 7);
+}
+
+void parsesColorsStrictly() {
+  RgbColor c = {0, 0, 0};
+  CHECK(parseColor("#FF8000", c) && c.r == 255 && c.g == 128 && c.b == 0);
+  char out[7];
+  CHECK(formatColor(c, out) == 6 && strcmp(out, "ff8000") == 0);
+  CHECK(!parseColor("ff800", c));
+  CHECK(!parseColor("ff80001", c));
+  CHECK(!parseColor("ff80zz", c));
+  CHECK(!parseColor("", c));
+}
+
+void parsesLocationsStrictly() {
+  GeoLocation l = {0, 0};
+  CHECK(parseLocation("525200000,-133600000", l) && l.lat == 525200000 && l.lon == -133600000);
+  CHECK(parseLocation("-900000000,1800000000", l) && l.lat == -900000000 && l.lon == 1800000000);
+  char out[24];
+  formatLocation(l, out);
+  CHECK(strcmp(out, "-900000000,1800000000") == 0);
+  CHECK(!parseLocation("1,2,3", l));
+  CHECK(!parseLocation("abc,def", l));
+  CHECK(!parseLocation(",5", l));
+  CHECK(!parseLocation("5,", l));
+  CHECK(!parseLocation("1.5,2", l));
+  CHECK(!parseLocation("900000001,0", l));
+  CHECK(!parseLocation("0,99999999999", l));
+  CHECK(l.lat == -900000000 && l.lon == 1800000000);
+}
+
+void rejectsMalformedWrites() {
+  startDevice();
+  CHECK(loopback.connected());
+  deliver("sc/dev/msg/recv", "id=lamp;value=00ff00");
+  deliver("sc/dev/msg/recv", "id=place;value=10,20");
+  run(3);
+  CHECK(lamp.Color().g == 255);
+  CHECK(place.Location().lat == 10 && place.Location().lon == 20);
+  deliver("sc/dev/msg/recv", "id=lamp;value=red");
+  deliver("sc/dev/msg/recv", "id=place;value=here,there");
+  run(3);
+  CHECK(lamp.Color().g == 255);
+  CHECK(place.Location().lat == 10 && place.Location().lon == 20);
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  lamp.setDataType(DataType::Color).setAccessMode(AccessMode::ReadWrite);
+  place.setDataType(DataType::Location).setAccessMode(AccessMode::ReadWrite);
+  RUN(formatsAndParsesHex);
+  RUN(parsesColorsStrictly);
+  RUN(parsesLocationsStrictly);
+  RUN(rejectsMalformedWrites);
+  return hostResult();
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2019-2024 Sensora LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Periodic sample windows keep their length when a publish is skipped
+// because the aggregate did not change, and without aggregation publish the
+// newest sample however fast samples arrive.
+
+#include <Arduino.h>
+#include <SensoraDevice.h>
+
+#include "HostBoard.h"
+#include "HostTest.h"
+
+Property rate("rate");
+float rateSamples[32];
+
+void windowsKeepTheirLengthWhenPublishIsSkipped() {
+  rate.setDataType(DataType::Integer)
+      .setSyncStrategy(SyncStrategy::Periodic, 1000)
+      .setSampleBuffer(rateSamples, 32)
+      .setAggregation(Aggregation::Count);
+  startDevice();
+
+  // one sample every 10 ms counts 100 per window, publishing the same
+  // value every time after the first full window
+  unsigned long published = loopback.sentCount();
+  int wrongCounts = 0;
+  for (int i = 0; i < 600; i++) {
+    rate.pushSample(1);
+    run(1);
+    if (i >= 200 && rate.Int() != 100) {
+      wrongCounts++;
+    }
+  }
+  CHECK(wrongCounts == 0);
+  CHECK(sentMessage(loopback, "msg/pub", "id=rate;value=100"));
+  CHECK(loopback.sentCount() - published <= 3);
+}
+
+Property level("level");
+float levelSamples[32];
+
+void periodicPublishesNewestSample() {
+  level.setDataType(DataType::Integer).setSyncStrategy(SyncStrategy::Periodic, 1000).setSampleBuffer(levelSamples, 32);
+  uint32_t dropsBefore = level.sampleDrops();
+  // four samples per millisecond, far more than the ring holds per window.
+  // Whenever the value changes it must be one of the latest samples
+  int sample = 0;
+  int last = level.Int();
+  int updates = 0;
+  int stale = 0;
+  for (int ms = 0; ms < 3500; ms++) {
+    for (int j = 0; j < 4; j++) {
+      level.pushSample(sample++);
+    }
+    run(1, 1);
+    if (level.Int() != last) {
+      last = level.Int();
+      updates++;
+      if (sample - 1 - last >= 4) {
+        stale++;
+      }
+    }
+  }
+  CHECK(updates >= 3);
+  CHECK(stale == 0);
+  CHECK(level.sampleDrops() == dropsBefore);
+}
+
+int main() {
+  copyString("dev", deviceConfig.deviceId);
+  RUN(windowsKeepTheirLengthWhenPublishIsSkipped);
+  RUN(periodicPublishesNewestSample);
+  return hostResult();
+}